@@ -5,40 +5,42 @@
 #include <esp_sleep.h>
 
 #include <../../G2L_Receiver/src/common.h>
+#include "transmit.hpp"
+#include "power.hpp"
 
 const int PIN_BUTTON = 9;
 const int PIN_BAT_DIV = 4; // battery resistive divider
 
 const int SEND_INTERVAL_HOLD = 25000;   // us when to send the hold event
-
-payload_t payload = {
+const int SEND_HOLD_JITTER = 4000;      // us, random part on top, spreads buttons held at the same time
+// the receiver drops repeats by sequence number and recovers a lost pressed or released
+// packet from the next one, so fewer repeats are needed than with v1
+const int REPEATS_PRESSED = 2;
+const int REPEATS_HOLD = 1;
+const int REPEATS_RELEASED = 2;
+const int REPEATS_CHECKIN = 1;
+
+const uint32_t CHECKIN_INTERVAL = 10 * 60 * 1000;       // ms, battery report while idle
+const uint32_t CHECKIN_JITTER = 30 * 1000;              // ms
+const uint32_t DEEP_SLEEP_TIMEOUT = 30 * 60 * 1000;     // ms idle until deep sleep, waking from it takes a boot
+const uint32_t SLEEP_MIN = 2000;                        // us, shorter waits aren't worth a light sleep
+
+payload_v3_t payload = {
     .preamble = G2L_PREAMBLE,
+    .version = G2L_PROTOCOL_V3,
 };
-esp_now_peer_info_t peer = {
-    .peer_addr = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF},
-    .channel = 0,
-    .encrypt = false,
-};
-
-
-// round about 0.6mA in light sleep
-void delaySleep(uint32_t us) {
-    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
-    esp_sleep_enable_timer_wakeup(us);
-    esp_light_sleep_start();
+// kept through deep sleep, so the receiver doesn't see a restart
+RTC_DATA_ATTR uint16_t txSeq = 0;
+RTC_DATA_ATTR uint16_t pressCount = 0;
+EspNowTransport espNow;
+Transmitter tx(espNow, TRANSPORT_BROADCAST);
+BatteryMonitor battery(PIN_BAT_DIV);
+PowerManager power(PIN_BUTTON);     // round about 0.6mA in light sleep
+
+void txSent(bool ok) {
+    tx.onSent(ok);
 }
 
-void enterSleep() {
-    esp_deep_sleep_enable_gpio_wakeup(digitalPinToBitMask(PIN_BUTTON), ESP_GPIO_WAKEUP_GPIO_LOW);
-    esp_deep_sleep_start();
-}
-
-// bool espNowTxDone = true;
-// void espNowTxCb(const uint8_t *mac_addr, esp_now_send_status_t status) {
-//     // Serial.println(micros());
-//     espNowTxDone = true;
-// }
-
 void print_wakeup_reason() {
   esp_sleep_wakeup_cause_t wakeup_reason;
 
@@ -50,11 +52,32 @@ void print_wakeup_reason() {
     case ESP_SLEEP_WAKEUP_TIMER:    Serial.println("Wakeup caused by timer"); break;
     case ESP_SLEEP_WAKEUP_TOUCHPAD: Serial.println("Wakeup caused by touchpad"); break;
     case ESP_SLEEP_WAKEUP_ULP:      Serial.println("Wakeup caused by ULP program"); break;
+    case ESP_SLEEP_WAKEUP_GPIO:     Serial.println("Wakeup caused by the button"); break;
     default:                        Serial.printf("Wakeup was not caused by deep sleep: %d\n", wakeup_reason); break;
   }
 }
 
+uint32_t idleSince = 0;         // ms, last button activity
+uint32_t nextCheckin = 0;       // ms
+bool deepSleepPossible = false; // the button pin can wake from deep sleep
+bool pressed = false;
+bool statsPending = false;
+uint32_t nextHold = 0;
+
+uint32_t checkinDelay() { return CHECKIN_INTERVAL + esp_random() % CHECKIN_JITTER; }
+
+void send(uint8_t btnState, int repeats, uint32_t pressTime = 0) {
+    payload.btnState = btnState;
+    payload.batVolt = battery.mV();
+    if (btnState == BTN_PRESSED) pressCount++;
+    if (btnState != BTN_CHECKIN) txSeq++;
+    payload.seq = txSeq;
+    payload.pressCount = pressCount;
+    tx.queue(payload, repeats, pressTime);
+}
+
 void setup() {
+    power.begin();
     Serial.begin(115200);
     pinMode(PIN_BUTTON, INPUT_PULLUP);
     pinMode(8, OUTPUT);
@@ -63,87 +86,127 @@ void setup() {
     // additional logic GNDs
     // pinMode(10, OUTPUT);
     // digitalWrite(10, LOW);
+    gpio_hold_dis((gpio_num_t)3);   // held through deep sleep
     pinMode(3, OUTPUT);
     digitalWrite(3, LOW);
     // pinMode(1, OUTPUT);
     // digitalWrite(1, LOW);
 
     print_wakeup_reason();
+    deepSleepPossible = power.canDeepSleep();
+    if (!deepSleepPossible) {
+        Serial.printf("Button pin %d can't wake from deep sleep, staying in light sleep\n", PIN_BUTTON);
+    }
 
     WiFi.mode(WIFI_STA);
 
-    if (esp_now_init() != ESP_OK) {
+    if (!espNow.begin()) {
         Serial.println("Error initializing ESP-NOW");
         return;
     }
 
     // Add peer
-    if (esp_now_add_peer(&peer) != ESP_OK) {
+    if (!espNow.addPeer(TRANSPORT_BROADCAST)) {
         Serial.println("Failed to add peer");
         return;
     }
 
-    // esp_now_register_send_cb(espNowTxCb);
+    espNow.onSent(txSent);
+    battery.begin();
 
     // basically disable ESP-NOW RX, only ~20mA left instead of ~80mA
     esp_now_set_wake_window(0);
-}
-
-esp_err_t send(payload_t payload, int repeats = 1, bool delayAfter = true) {
-    payload.batVolt = analogReadMilliVolts(PIN_BAT_DIV) / 2;
 
-    esp_err_t result = ESP_OK;
-    for (int i = 0; i < repeats; i++) {
-        // espNowTxDone = false;
-        result = esp_now_send(peer.peer_addr, (uint8_t *)&payload, sizeof(payload));
-        if (result != ESP_OK) break;
+    // a timer wakeup from deep sleep is a check-in, go back to sleep right after it
+    nextCheckin = millis() + checkinDelay();
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER) {
+        idleSince = millis() - DEEP_SLEEP_TIMEOUT;
+        nextCheckin = millis();
     }
 
-    // Serial.print(micros());
-
-    if (delayAfter) {
-        delayMicroseconds(10000);   // needed because of random high power draw (30mA and falling) when entering sleep too early?
+    // a press woke us from deep sleep. A tap is usually over before the radio is up, so
+    // send the press now, loop() sends the release (or the holds) from the pin's state.
+    // The time since the edge is unknown, so the press isn't measured
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO) {
+        send(BTN_PRESSED, REPEATS_PRESSED);
+        pressed = true;
+        nextHold = micros() + SEND_INTERVAL_HOLD + esp_random() % SEND_HOLD_JITTER;
     }
-    return result;
 }
 
-void sleepUntilButtonIO() {
-    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
-    gpio_wakeup_enable((gpio_num_t)PIN_BUTTON, GPIO_INTR_LOW_LEVEL);
-    esp_sleep_enable_gpio_wakeup();
-    esp_light_sleep_start();
-
-    // uint64_t gpioMask = esp_sleep_get_gpio_wakeup_status();
-    // Serial.printf("Wake from sleep. Mask: %016X\n", gpioMask);
-    // digitalWrite(8, LOW);
+void printTxStats() {
+    const Transmitter::Stats &st = tx.stats();
+    Serial.printf("press->air: %uus (avg %uus, max %uus, %u presses), sent: %u, failed: %u, timeouts: %u\n",
+        st.latencyLastUs, st.latencyAvgUs(), st.latencyMaxUs, st.presses, st.sent, st.failed, st.timeouts);
 }
 
-uint32_t lastBlink = 0;
-
+// Power states: awake while the radio is busy, light sleep until the next hold packet
+// (or the release) while pressed, light sleep until a press or the next check-in while
+// idle, deep sleep after DEEP_SLEEP_TIMEOUT without a press.
 void loop() {
-    // sleepUntilButtonIO();
-    // ToDo: regular wakeup for checkin message?
-
-    if (millis() - lastBlink > 250) {
-        lastBlink = millis();
-        digitalWrite(8, !digitalRead(8));
+    // the press is checked first, nothing else runs between detecting it and sending
+    bool down = digitalRead(PIN_BUTTON) == LOW;
+    uint32_t now = micros();
+    if (down && !pressed) {
+        send(BTN_PRESSED, REPEATS_PRESSED, now);
+        nextHold = now + SEND_INTERVAL_HOLD + esp_random() % SEND_HOLD_JITTER;
+    }
+    else if (down && (int32_t)(now - nextHold) >= 0) {
+        send(BTN_HOLD, REPEATS_HOLD);
+        nextHold += SEND_INTERVAL_HOLD + esp_random() % SEND_HOLD_JITTER;
+    }
+    else if (!down && pressed) {
+        send(BTN_RELEASED, REPEATS_RELEASED);
+        statsPending = true;
+    }
+    pressed = down;
+    if (down) {
+        idleSince = millis();
     }
 
-    if (digitalRead(PIN_BUTTON) == HIGH) {
+    // stay awake until the radio is done, sleeping too early draws extra current
+    tx.update();
+    if (!tx.idle()) {
         return;
     }
 
-    payload.btnState = BTN_PRESSED;
-    send(payload, 3);
+    battery.update();
+    if (statsPending) {
+        statsPending = false;
+        printTxStats();
+        power.report();
+    }
+
+    if (pressed) {
+        // the release wakes up early
+        int32_t wait = nextHold - micros();
+        if (wait > (int32_t)SLEEP_MIN) {
+            power.lightSleep(wait, HIGH);
+        }
+        return;
+    }
 
-    while (!digitalRead(PIN_BUTTON)) {
-        payload.btnState = BTN_HOLD;
-        send(payload, 2);
-        // delaySleep(SEND_INTERVAL_HOLD); // TODO: need to randomize this a bit?
-        delayMicroseconds(SEND_INTERVAL_HOLD);
+    if ((int32_t)(millis() - nextCheckin) >= 0) {
+        nextCheckin = millis() + checkinDelay();
+        send(BTN_CHECKIN, REPEATS_CHECKIN);
+        power.report();
+        return;
     }
 
-    payload.btnState = BTN_RELEASED;
-    send(payload, 3);
+    uint32_t idle = millis() - idleSince;
+    if (idle >= DEEP_SLEEP_TIMEOUT && deepSleepPossible) {
+        Serial.flush();
+        gpio_hold_en((gpio_num_t)3);    // the button needs its GND while asleep
+        gpio_deep_sleep_hold_en();
+        if (!power.deepSleep((uint64_t)checkinDelay() * 1000)) {
+            deepSleepPossible = false;
+            gpio_hold_dis((gpio_num_t)3);
+            Serial.println("Deep sleep failed, staying in light sleep");
+        }
+    }
 
+    // a press wakes up early
+    uint32_t wait = nextCheckin - millis();
+    if (deepSleepPossible && DEEP_SLEEP_TIMEOUT - idle < wait) wait = DEEP_SLEEP_TIMEOUT - idle;
+    power.lightSleep(wait * 1000, LOW);
 }
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include <sys/time.h>
+
+// Sleep handling of the button and a rough energy account. Light sleep keeps the radio
+// set up and wakes within about a millisecond, deep sleep boots again on wakeup. The
+// time spent in each mode is kept in RTC memory, so it survives deep sleep.
+
+// typical supply currents of the C3 mini, for the estimate only
+static const uint32_t CURRENT_AWAKE_UA = 20000;        // ESP-NOW up, RX wake window 0
+static const uint32_t CURRENT_LIGHT_SLEEP_UA = 600;
+static const uint32_t CURRENT_DEEP_SLEEP_UA = 50;      // incl. divider and regulator
+static const uint32_t BATTERY_CAPACITY_MAH = 500;
+
+struct PowerStats {
+    uint64_t awakeUs;
+    uint64_t lightSleepUs;
+    uint64_t deepSleepUs;
+    uint32_t lightSleeps;
+    uint32_t deepSleeps;
+    int64_t deepSleepStart;     // wall clock us, 0 when not in deep sleep
+};
+
+RTC_DATA_ATTR PowerStats rtcPowerStats;
+
+class PowerManager {
+    public:
+    PowerManager(int wakePin) : _wakePin(wakePin) {}
+
+    // call first thing in setup
+    void begin() {
+        PowerStats &st = rtcPowerStats;
+        if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UNDEFINED) {
+            st = PowerStats();      // power on, RTC memory is garbage
+        }
+        else if (st.deepSleepStart) {
+            st.deepSleepUs += wallTimeUs() - st.deepSleepStart;
+        }
+        st.deepSleepStart = 0;
+    }
+
+    // sleeps until timeoutUs passed or the wake pin reaches wakeLevel, returns true on the pin
+    bool lightSleep(uint32_t timeoutUs, int wakeLevel) {
+        esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+        esp_sleep_enable_timer_wakeup(timeoutUs);
+        gpio_wakeup_enable((gpio_num_t)_wakePin, wakeLevel == LOW ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+        esp_sleep_enable_gpio_wakeup();
+
+        int64_t start = esp_timer_get_time();
+        esp_light_sleep_start();
+        _lightSleepUs += esp_timer_get_time() - start;
+        rtcPowerStats.lightSleeps++;
+        return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO;
+    }
+
+    // whether the wake pin can wake the chip from deep sleep (C3: GPIO0-5 only)
+    bool canDeepSleep() const { return esp_sleep_is_valid_wakeup_gpio((gpio_num_t)_wakePin); }
+
+    // wakes up on a press (pin low) or after timeoutUs, through a reboot. Only returns if
+    // the pin can't wake from deep sleep, see canDeepSleep()
+    bool deepSleep(uint64_t timeoutUs) {
+        esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+        if (esp_deep_sleep_enable_gpio_wakeup(1ULL << _wakePin, ESP_GPIO_WAKEUP_GPIO_LOW) != ESP_OK) {
+            return false;
+        }
+        esp_sleep_enable_timer_wakeup(timeoutUs);
+
+        PowerStats &st = rtcPowerStats;
+        st.awakeUs += awakeThisBootUs();
+        st.lightSleepUs += _lightSleepUs;
+        st.deepSleeps++;
+        st.deepSleepStart = wallTimeUs();
+        esp_deep_sleep_start();
+        return false;
+    }
+
+    void report() {
+        const PowerStats &st = rtcPowerStats;
+        uint64_t awake = st.awakeUs + awakeThisBootUs();
+        uint64_t light = st.lightSleepUs + _lightSleepUs;
+        uint64_t deep = st.deepSleepUs;
+        uint64_t total = awake + light + deep;
+        if (total == 0) return;
+
+        // average current in uA and charge used so far
+        uint64_t avgUa = (awake * CURRENT_AWAKE_UA + light * CURRENT_LIGHT_SLEEP_UA + deep * CURRENT_DEEP_SLEEP_UA) / total;
+        uint32_t usedUah = avgUa * total / 3600000000ULL;
+        uint32_t lifeH = avgUa ? BATTERY_CAPACITY_MAH * 1000ULL / avgUa : 0;
+        Serial.printf("power: awake %u.%u%%, light sleep %u.%u%% (%u), deep sleep %u.%u%% (%u), avg %uuA, used %uuAh, ~%uh on %umAh\n",
+            permille(awake, total) / 10, permille(awake, total) % 10,
+            permille(light, total) / 10, permille(light, total) % 10, st.lightSleeps,
+            permille(deep, total) / 10, permille(deep, total) % 10, st.deepSleeps,
+            (uint32_t)avgUa, usedUah, lifeH, BATTERY_CAPACITY_MAH);
+    }
+
+    protected:
+    uint64_t awakeThisBootUs() const { return esp_timer_get_time() - _lightSleepUs; }
+
+    static uint32_t permille(uint64_t part, uint64_t total) { return part * 1000 / total; }
+
+    // keeps running through deep sleep
+    static int64_t wallTimeUs() {
+        struct timeval tv;
+        gettimeofday(&tv, nullptr);
+        return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    }
+
+    int _wakePin;
+    uint64_t _lightSleepUs = 0;     // this boot
+};
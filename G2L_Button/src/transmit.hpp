@@ -0,0 +1,145 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <algorithm>
+
+#include <../../G2L_Receiver/src/common.h>
+#include <../../G2L_Receiver/src/transport.hpp>
+
+// Transmit path of the button. The first packet of a state change goes out right away,
+// its repeats follow once the radio reported the previous one as sent, with a random gap
+// so buttons pressed at the same time don't keep colliding. The battery voltage is
+// sampled while the radio is idle, so reading the ADC never delays a packet.
+
+static const uint32_t TX_REPEAT_GAP_MIN = 1500;    // us between repeats of the same packet
+static const uint32_t TX_REPEAT_GAP_JITTER = 2000; // us, random part on top
+static const uint32_t TX_TIMEOUT = 10000;          // us, give up waiting for the send callback
+
+static const uint32_t BAT_SAMPLE_INTERVAL = 1000;  // ms
+static const int BAT_FILTER_SHIFT = 3;             // exponential average over ~8 samples
+
+class BatteryMonitor {
+    public:
+    BatteryMonitor(int pin) : _pin(pin) {}
+
+    void begin() {
+        _filtered = sample() << BAT_FILTER_SHIFT;
+        _lastSample = millis();
+    }
+
+    // call when nothing time critical is going on
+    void update() {
+        if (millis() - _lastSample < BAT_SAMPLE_INTERVAL) return;
+        _lastSample = millis();
+        _filtered += sample() - (_filtered >> BAT_FILTER_SHIFT);
+    }
+
+    uint16_t mV() const { return _filtered >> BAT_FILTER_SHIFT; }
+
+    protected:
+    uint32_t sample() { return analogReadMilliVolts(_pin) / 2; }
+
+    int _pin;
+    uint32_t _filtered = 0;
+    uint32_t _lastSample = 0;
+};
+
+class Transmitter {
+    public:
+    struct Stats {
+        uint32_t sent = 0;
+        uint32_t failed = 0;
+        uint32_t timeouts = 0;
+        uint32_t presses = 0;       // press -> air latency
+        uint32_t latencyLastUs = 0;
+        uint32_t latencyMaxUs = 0;
+        uint64_t latencySumUs = 0;
+
+        uint32_t latencyAvgUs() const { return presses ? latencySumUs / presses : 0; }
+    };
+
+    Transmitter(Transport &transport, const uint8_t *peerAddr) : _transport(transport), _peerAddr(peerAddr) {}
+
+    // replaces whatever is still pending, a newer button state makes old repeats useless.
+    // pressTime: micros() when the press was detected, to measure the press -> air latency
+    void queue(const payload_v3_t &payload, int repeats, uint32_t pressTime = 0) {
+        _payload = payload;
+        _remaining = repeats;
+        _measureNext = pressTime != 0;
+        _pressTime = pressTime;
+        _nextSend = micros();   // no gap for a new state
+        update();
+    }
+
+    // call as often as possible from the loop
+    void update() {
+        uint32_t now = micros();
+        if (_inFlight) {
+            if (_doneTime.load(std::memory_order_acquire) == 0) {
+                if (now - _sendTime < TX_TIMEOUT) return;
+                _stats.timeouts++;
+            }
+            else {
+                finish();
+            }
+            _inFlight = false;
+        }
+        if (_remaining <= 0 || (int32_t)(now - _nextSend) < 0) return;
+
+        _doneTime.store(0, std::memory_order_relaxed);
+        _sendTime = now;
+        // our part of the press latency, for the receiver's tracing
+        _payload.txDelay = _pressTime ? std::min<uint32_t>(now - _pressTime, UINT16_MAX) : 0;
+        if (!_transport.send(_peerAddr, (const uint8_t *)&_payload, sizeof(_payload))) {
+            _stats.failed++;
+            _remaining = 0;
+            return;
+        }
+        _inFlight = true;
+        _measureInFlight = _measureNext;    // a packet still in flight from before doesn't count
+        _measureNext = false;
+        _remaining--;
+    }
+
+    // from the send callback (WiFi task)
+    void onSent(bool ok) {
+        _doneOk = ok;
+        uint32_t now = micros();
+        _doneTime.store(now ? now : 1, std::memory_order_release);
+    }
+
+    bool idle() const { return !_inFlight && _remaining <= 0; }
+    const Stats &stats() const { return _stats; }
+
+    protected:
+    void finish() {
+        uint32_t done = _doneTime.load(std::memory_order_relaxed);
+        if (_doneOk) _stats.sent++;
+        else _stats.failed++;
+
+        // the first packet after a press is the one that counts
+        if (_measureInFlight) {
+            uint32_t latency = done - _pressTime;
+            _stats.presses++;
+            _stats.latencyLastUs = latency;
+            _stats.latencySumUs += latency;
+            if (latency > _stats.latencyMaxUs) _stats.latencyMaxUs = latency;
+        }
+        _nextSend = done + TX_REPEAT_GAP_MIN + esp_random() % TX_REPEAT_GAP_JITTER;
+    }
+
+    Transport &_transport;
+    const uint8_t *_peerAddr;
+    payload_v3_t _payload;
+    int _remaining = 0;
+    bool _inFlight = false;
+    bool _measureNext = false, _measureInFlight = false;
+    uint32_t _pressTime = 0;
+    uint32_t _sendTime = 0;
+    uint32_t _nextSend = 0;
+
+    std::atomic<uint32_t> _doneTime{0};     // 0 while the current packet is in flight
+    volatile bool _doneOk = true;
+    Stats _stats;
+};
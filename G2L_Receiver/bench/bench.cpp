@@ -0,0 +1,152 @@
+// Host-side micro-benchmark for the effect engine (pio run -e native -t exec).
+// Runs EffectEngine::loop() on a simulated clock for several pixel counts and
+// effect combinations, and prints the wall clock cost per rendered frame. The
+// "convert" rows are the 16 -> 8 bit output conversion (gamma + dithering) alone, the
+// "ledmap" rows map the frame onto a whole LED strip, convert it and hand it to a driver.
+
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+
+#include "effect.hpp"
+#include "output.hpp"
+#include "pixelmap.hpp"
+#include "leddriver.hpp"
+
+static const uint32_t FRAME_MS = 5;             // simulated time between frames
+static const uint32_t HOLD_INTERVAL_MS = 25;    // same pacing as SEND_INTERVAL_HOLD on the button
+static const uint64_t MIN_BENCH_NS = 200000000; // run each scenario for at least 200ms wall time
+static const int MIN_FRAMES = 200;
+
+struct Scenario {
+    const char *name;
+    std::vector<int> held;  // effect indices kept triggered during the run
+};
+
+static const Scenario scenarios[] = {
+    { "idle",               { } },
+    { "strobe",             { 0 } },
+    { "oddeven",            { 1 } },
+    { "rainbowflash",       { 2 } },
+    { "palettewave",        { 3 } },
+    { "strobe+oddeven",     { 0, 1 } },
+    { "oddeven+rainbow",    { 1, 2 } },
+    { "all",                { 0, 1, 2, 3 } },
+};
+
+static const uint16_t pixelCounts[] = { 2, 24, 170, 512 };
+
+volatile uint32_t sink;     // keeps the compiler from dropping the rendered output
+
+// release everything and let all effects (and the idle fade-up) run out
+static void settle() {
+    for (int e = 0; e < effectsNum; e++) {
+        fx.trigger(e, BTN_RELEASED);
+    }
+    for (int i = 0; i < 4; i++) {
+        native::advanceMillis(AFTER_EFFECT_PAUSE + AFTER_EFFECT_FADE_UP);
+        fx.loop();
+    }
+}
+
+static void runScenario(const Scenario &sc, uint16_t numPixels) {
+    settle();
+    for (int e : sc.held) {
+        fx.trigger(e, BTN_PRESSED);
+    }
+
+    uint32_t lastHold = millis();
+    uint64_t elapsedNs = 0;
+    int frames = 0;
+    while (elapsedNs < MIN_BENCH_NS || frames < MIN_FRAMES) {
+        native::advanceMillis(FRAME_MS);
+        if (millis() - lastHold >= HOLD_INTERVAL_MS) {
+            lastHold = millis();
+            for (int e : sc.held) {
+                fx.trigger(e, BTN_HOLD);
+            }
+        }
+
+        auto t0 = std::chrono::steady_clock::now();
+        fx.loop();
+        auto t1 = std::chrono::steady_clock::now();
+        elapsedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        frames++;
+
+        sink = sink + fx.frame()[frames % numPixels].r;
+    }
+
+    double nsPerFrame = (double)elapsedNs / frames;
+    printf("%6u  %-18s %12.1f %12.0f %10.2f\n",
+        numPixels, sc.name, nsPerFrame, 1e9 / nsPerFrame, nsPerFrame / numPixels);
+}
+
+// the rendered idle frame through a gamma + white balance + dithering output stage
+static void runConvert(uint16_t numPixels) {
+    static OutputConverter<512> output(ledCurve, LED_BALANCE, true);
+    std::vector<CRGB> pixels(numPixels);
+    settle();
+
+    uint64_t elapsedNs = 0;
+    int frames = 0;
+    while (elapsedNs < MIN_BENCH_NS || frames < MIN_FRAMES) {
+        auto t0 = std::chrono::steady_clock::now();
+        output.convert(fx.frame(), pixels.data(), numPixels);
+        auto t1 = std::chrono::steady_clock::now();
+        elapsedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        frames++;
+        sink = sink + pixels[frames % numPixels].r;
+    }
+
+    double nsPerFrame = (double)elapsedNs / frames;
+    printf("%6u  %-18s %12.1f %12.0f %10.2f\n",
+        numPixels, "convert", nsPerFrame, 1e9 / nsPerFrame, nsPerFrame / numPixels);
+}
+
+// an N LED strip showing half as many effect pixels, mirrored, so every LED is interpolated
+template <size_t N>
+static void runLedMap() {
+    static PixelMap<N> map;
+    static RGB16 mapped[N];
+    static CRGB leds[N];
+    static OutputConverter<N> output(ledCurve, LED_BALANCE, true);
+    static SimLedDriver<N> driver;
+    LedSegment segment = { .first = 0, .length = N, .pixel = 0, .numPixels = N / 2, .mode = MAP_MIRROR };
+    map.init(&segment, 1);
+    fx.init(map.numPixels());
+    settle();
+
+    uint64_t elapsedNs = 0;
+    int frames = 0;
+    while (elapsedNs < MIN_BENCH_NS || frames < MIN_FRAMES) {
+        auto t0 = std::chrono::steady_clock::now();
+        map.render(fx.frame(), mapped);
+        output.convert(mapped, leds, N);
+        driver.show(leds);
+        auto t1 = std::chrono::steady_clock::now();
+        elapsedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        frames++;
+        native::advanceMillis(FRAME_MS);
+        sink = sink + driver.frame()[frames % N].r;
+    }
+
+    double nsPerFrame = (double)elapsedNs / frames;
+    printf("%6u  %-18s %12.1f %12.0f %10.2f   (%uus on the wire)\n",
+        (unsigned)N, "ledmap", nsPerFrame, 1e9 / nsPerFrame, nsPerFrame / N, driver.wireUs());
+}
+
+int main() {
+    printf("%6s  %-18s %12s %12s %10s\n", "pixels", "scenario", "ns/frame", "frames/s", "ns/pixel");
+
+    for (uint16_t numPixels : pixelCounts) {
+        fx.init(numPixels);
+
+        for (const Scenario &sc : scenarios) {
+            runScenario(sc, numPixels);
+        }
+        runConvert(numPixels);
+    }
+    runLedMap<24>();
+    runLedMap<300>();
+    return 0;
+}
@@ -0,0 +1,319 @@
+// Host-side load test of the receiver's packet path (pio run -e loadgen -t exec). Simulated
+// buttons send the packet pattern of G2L_Button (pressed, hold every SEND_INTERVAL_HOLD,
+// released, each with its repeats) over UDP on localhost. The receiving side is the
+// firmware's path: receive callback on its own thread -> queueButtonPacket() -> 100Hz render
+// loop with ButtonEventDispatcher (registry and tracker) and the effect engine. The number of buttons is
+// ramped up step by step, each step prints packets/s, drops, queue depth and the time
+// from the receive callback to the tracker. Between steps the sender pauses until the
+// packets in flight arrived, so the counts of a step cover the same packets on both sides.
+//
+// usage: program [-n max_buttons] [-t seconds_per_step] [-l loss_percent] [-p port]
+
+#include <Arduino.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+
+#include "effect.hpp"
+#include "buttons.hpp"
+#include "events.hpp"
+#include "scheduler.hpp"
+#include "transport.hpp"
+
+// as in G2L_Button (src/main.cpp, src/transmit.hpp)
+static const uint32_t SEND_INTERVAL_HOLD = 25000;  // us
+static const uint32_t SEND_HOLD_JITTER = 4000;
+static const int REPEATS_PRESSED = 2;
+static const int REPEATS_HOLD = 1;
+static const int REPEATS_RELEASED = 2;
+static const uint32_t TX_REPEAT_GAP_MIN = 1500;    // us
+static const uint32_t TX_REPEAT_GAP_JITTER = 2000;
+
+// how the simulated people press: held for 0.2-2s, then idle for 0.3-3s
+static const uint32_t HOLD_MIN = 200000, HOLD_MAX = 2000000;    // us
+static const uint32_t IDLE_MIN = 300000, IDLE_MAX = 3000000;
+
+static const int FRAME_RATE = 100;
+static const int LATENCY_BUCKET_US = 100;
+static const int LATENCY_BUCKETS = 500;
+static const uint32_t RX_QUIET_US = 20000;     // at the end of a step, nothing received for this long: nothing in flight
+
+static uint64_t realUs() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct VirtualButton {
+    uint8_t mac[6];
+    bool paired;                // in the receiver's registry
+    payload_v3_t payload;
+    bool pressed = false;
+    uint64_t nextChange = 0;    // press or release
+    uint64_t nextHold = 0;
+    int repeatsLeft = 0;
+    uint64_t nextRepeat = 0;
+};
+
+// sender side, one socket for all buttons
+class LoadGenerator {
+    public:
+    std::atomic<uint32_t> sent{0};
+    std::atomic<uint32_t> presses{0};       // by paired buttons, the others are never seen
+    std::atomic<uint32_t> handedOver{0};    // packets the socket took, not dropped by -l
+
+    LoadGenerator(int maxButtons, double lossPercent, uint16_t port)
+        : _buttons(maxButtons), _lossPercent(lossPercent), _transport(TRANSPORT_BROADCAST, 0, port) {
+        for (int i = 0; i < maxButtons; i++) {
+            VirtualButton &b = _buttons[i];
+            uint8_t addr[6] = { 0x02, 0x47, 0x32, 0x4C, (uint8_t)(i >> 8), (uint8_t)i };  // locally administered
+            memcpy(b.mac, addr, 6);
+            b.paired = i < MAX_BUTTONS;
+            b.payload = { .preamble = G2L_PREAMBLE, .version = G2L_PROTOCOL_V3 };
+        }
+    }
+
+    const uint8_t *mac(int i) const { return _buttons[i].mac; }
+    bool begin() { return _transport.begin(); }
+    void setActive(int n) { _active = n; }
+
+    // stops sending, returns once the sender thread is idle
+    void pause() {
+        _pause = true;
+        while (!_paused) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    void resume() {
+        _paused = false;
+        _pause = false;
+    }
+
+    void run(std::atomic<bool> &stop) {
+        while (!stop) {
+            if (_pause) {
+                _paused = true;
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            uint64_t now = realUs();
+            for (int i = 0; i < _active; i++) step(_buttons[i], now);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    protected:
+    void step(VirtualButton &b, uint64_t now) {
+        if (!b.pressed && now >= b.nextChange) {
+            b.pressed = true;
+            b.payload.pressCount++;
+            queue(b, BTN_PRESSED, REPEATS_PRESSED, now);
+            b.nextHold = now + SEND_INTERVAL_HOLD + _rng() % SEND_HOLD_JITTER;
+            b.nextChange = now + HOLD_MIN + _rng() % (HOLD_MAX - HOLD_MIN);
+            if (b.paired) presses++;
+        }
+        else if (b.pressed && now >= b.nextChange) {
+            b.pressed = false;
+            queue(b, BTN_RELEASED, REPEATS_RELEASED, now);
+            b.nextChange = now + IDLE_MIN + _rng() % (IDLE_MAX - IDLE_MIN);
+        }
+        else if (b.pressed && now >= b.nextHold) {
+            queue(b, BTN_HOLD, REPEATS_HOLD, now);
+            b.nextHold += SEND_INTERVAL_HOLD + _rng() % SEND_HOLD_JITTER;
+        }
+
+        if (b.repeatsLeft > 0 && now >= b.nextRepeat) {
+            b.repeatsLeft--;
+            b.nextRepeat = now + TX_REPEAT_GAP_MIN + _rng() % TX_REPEAT_GAP_JITTER;
+            sent++;
+            if (_rng() % 10000 >= _lossPercent * 100 && _transport.sendFrom(b.mac, (const uint8_t *)&b.payload, sizeof(b.payload))) {
+                handedOver++;
+            }
+        }
+    }
+
+    // a new state replaces the repeats still pending, like Transmitter::queue()
+    void queue(VirtualButton &b, uint8_t btnState, int repeats, uint64_t now) {
+        b.payload.btnState = btnState;
+        b.payload.seq++;
+        b.repeatsLeft = repeats;
+        b.nextRepeat = now;
+    }
+
+    std::vector<VirtualButton> _buttons;
+    int _active = 0;
+    std::atomic<bool> _pause{false}, _paused{false};
+    double _lossPercent;
+    UdpTransport _transport;
+    std::minstd_rand _rng{1};
+};
+
+// receiver side, the same parts as in G2L_Receiver/src/main.cpp
+ButtonEventQueue buttonEvents;
+ButtonRegistry buttonRegistry;
+std::atomic<uint32_t> rxPackets{0};
+
+struct StepStats {
+    uint32_t frames = 0;
+    uint32_t handled = 0;
+    uint32_t unknown = 0;
+    uint32_t pressed = 0;           // pressed packets of paired buttons, one per press
+    uint32_t extraPresses = 0;      // pressed by the tracker: recovered, or held on after a stuck release
+    uint32_t stuckReleases = 0;     // released by the tracker's timeout
+    uint32_t depthMax = 0;
+    uint32_t frameMaxUs = 0;        // button processing per frame
+    uint32_t latencyMaxUs = 0;
+    uint64_t latencySumUs = 0;
+    uint32_t histogram[LATENCY_BUCKETS] = {};
+
+    uint32_t percentileUs(int percent) const {
+        uint32_t target = ((uint64_t)handled * percent + 99) / 100, seen = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            seen += histogram[i];
+            if (seen >= target) return (i + 1) * LATENCY_BUCKET_US;
+        }
+        return latencyMaxUs;
+    }
+};
+StepStats stats;
+bool checkingStuck = false;
+
+uint16_t lastPressCount[MAX_BUTTONS];
+
+void handleButtonEvent(int buttonId, int btnState);
+int unknownButton(const ButtonEvent &ev);
+bool knownButton(const ButtonEvent &ev);
+ButtonTracker buttons(handleButtonEvent);
+ButtonEventDispatcher buttonDispatch(buttonEvents, buttonRegistry, buttons, unknownButton, knownButton);
+
+void handleButtonEvent(int buttonId, int btnState) {
+    const ButtonEvent *ev = buttonDispatch.current();
+    if (btnState == BTN_PRESSED && (!ev || ev->btnState != BTN_PRESSED)) stats.extraPresses++;
+    if (btnState == BTN_RELEASED && checkingStuck) stats.stuckReleases++;
+    fx.trigger(buttonId, btnState, millis());
+}
+
+// receive callback, runs on the receive thread like the WiFi task on the chip
+void packetRx(const uint8_t *srcMac, const uint8_t *data, int len, int8_t rssi) {
+    uint64_t now = realUs();
+    rxPackets++;
+    ButtonEvent ev = { .time = (uint32_t)(now / 1000), .buttonId = 0, .rxUs = (uint32_t)now, .rssi = rssi };
+    queueButtonPacket(buttonEvents, srcMac, data, len, ev);
+}
+
+// receive callback to dispatcher
+void recordLatency(const ButtonEvent &ev) {
+    uint32_t latency = (uint32_t)realUs() - ev.rxUs;
+    stats.handled++;
+    stats.latencySumUs += latency;
+    if (latency > stats.latencyMaxUs) stats.latencyMaxUs = latency;
+    stats.histogram[std::min(latency / LATENCY_BUCKET_US, (uint32_t)LATENCY_BUCKETS - 1)]++;
+}
+
+int unknownButton(const ButtonEvent &ev) {
+    recordLatency(ev);
+    stats.unknown++;
+    return -1;
+}
+
+bool knownButton(const ButtonEvent &ev) {
+    recordLatency(ev);
+    // the repeats of a pressed packet carry the same press count
+    if (ev.btnState == BTN_PRESSED && ev.pressCount != lastPressCount[ev.buttonId]) {
+        lastPressCount[ev.buttonId] = ev.pressCount;
+        stats.pressed++;
+    }
+    return ev.btnState != BTN_CHECKIN;
+}
+
+int main(int argc, char **argv) {
+    int maxButtons = 512;
+    uint32_t stepSeconds = 5;
+    double lossPercent = 0;
+    uint16_t port = 47110;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-n")) maxButtons = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-t")) stepSeconds = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-l")) lossPercent = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "-p")) port = atoi(argv[i + 1]);
+    }
+
+    LoadGenerator gen(maxButtons, lossPercent, port);
+    static const uint8_t rxMac[6] = { 0x02, 0x47, 0x32, 0x4C, 0xFF, 0xFF };
+    UdpTransport rx(rxMac, port, 0);
+    rx.onReceive(packetRx);
+    if (!gen.begin() || !rx.begin()) {
+        fprintf(stderr, "can't open UDP port %u on localhost\n", port);
+        return 1;
+    }
+    // all buttons paired, the registry holds MAX_BUTTONS, the rest shows up as unknown
+    for (int i = 0; i < maxButtons && i < MAX_BUTTONS; i++) buttonRegistry.add(gen.mac(i));
+    fx.init(2);
+
+    std::atomic<bool> stop{false};
+    std::thread sender([&] { gen.run(stop); });
+    std::thread receiver([&] {
+        while (!stop) {
+            if (!rx.poll()) std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    });
+
+    printf("%u s per step, %.1f%% loss on the sender, event queue %d, %d Hz frames\n",
+        stepSeconds, lossPercent, BUTTON_EVENT_QUEUE_SIZE, FRAME_RATE);
+    printf("%7s %9s %9s %9s %7s %7s %6s %7s %8s %8s %8s %8s %11s %6s %6s\n", "buttons", "sent/s", "rx/s", "handled/s",
+        "q.drop", "udp", "q.max", "unknown", "lat.avg", "lat.p99", "lat.max", "frame", "presses", "extra", "stuck");
+
+    FrameScheduler frameScheduler(FRAME_RATE);
+    auto frame = [&] {
+        if (!frameScheduler.due(realUs())) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            return;
+        }
+        native::simMicros = realUs();     // millis() for the tracker and effects
+        uint32_t start = micros();
+        stats.depthMax = std::max(stats.depthMax, (uint32_t)buttonEvents.size());
+        buttonDispatch.process();
+        checkingStuck = true;
+        buttons.checkStuck(millis());
+        checkingStuck = false;
+        uint32_t took = (uint32_t)realUs() - start;
+        stats.frameMaxUs = std::max(stats.frameMaxUs, took);
+        fx.loop(millis());
+        stats.frames++;
+    };
+
+    for (int active = 16; ; active = std::min(active * 2, maxButtons)) {
+        gen.setActive(active);
+        stats = StepStats();
+        uint32_t sent0 = gen.sent, handed0 = gen.handedOver, presses0 = gen.presses, rx0 = rxPackets, drop0 = buttonEvents.dropped();
+        uint64_t stepStart = realUs();
+        gen.resume();
+        while (realUs() - stepStart < stepSeconds * 1000000ULL) frame();
+
+        // let what is still in flight arrive, it belongs to this step
+        gen.pause();
+        double s = (realUs() - stepStart) / 1e6;
+        uint32_t lastRx = rxPackets;
+        for (uint64_t quietSince = realUs(); realUs() - quietSince < RX_QUIET_US; ) {
+            frame();
+            if (rxPackets != lastRx) {
+                lastRx = rxPackets;
+                quietSince = realUs();
+            }
+        }
+
+        uint32_t sent = gen.sent - sent0, handedOver = gen.handedOver - handed0, received = rxPackets - rx0;
+        uint32_t dropped = buttonEvents.dropped() - drop0;
+        printf("%7d %9.0f %9.0f %9.0f %7u %7u %6u %7u %6uus %6uus %6uus %6uus %5u/%-5u %6u %6u\n",
+            active, sent / s, received / s, stats.handled / s, dropped, handedOver - received, stats.depthMax, stats.unknown,
+            stats.handled ? (uint32_t)(stats.latencySumUs / stats.handled) : 0, stats.percentileUs(99), stats.latencyMaxUs,
+            stats.frameMaxUs, stats.pressed, gen.presses - presses0, stats.extraPresses, stats.stuckReleases);
+        fflush(stdout);
+        if (active == maxButtons) break;
+    }
+
+    stop = true;
+    sender.join();
+    receiver.join();
+    return 0;
+}
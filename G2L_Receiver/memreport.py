@@ -0,0 +1,55 @@
+# Post-build report of flash and RAM per subsystem, from the symbol sizes of the firmware
+# ELF (runs after linking the chip envs). The budgets for static RAM are checked at compile
+# time in src/main.cpp (memoryUse), this shows where the rest goes. Header-only code that
+# got inlined into setup() / loop() counts as "main", everything unmatched as "framework".
+
+Import("env")
+
+import re
+import subprocess
+
+# first match wins, on the demangled symbol name
+SUBSYSTEMS = [
+    ("effects",   r"[Ee]ffect|^FX|^fx$|[Rr]ainbow|blendLayer|palette"),
+    ("output",    r"OutputConverter|OutputGate|[Cc]urve"),
+    ("DMX",       r"[Dd]mx|DMX"),
+    ("LED",       r"[Ll]ed|LED|PixelMap|rmt|FastLED|CLEDController"),
+    ("buttons",   r"[Bb]utton|packetRx|loadButtons|saveButtons"),
+    ("sync",      r"ShowClock|showClock|[Bb]eacon|[Ss]ync"),
+    ("log",       r"[Ll]ogger|[Rr]ecorder|[Ll]atency"),
+    ("network",   r"NetOutput|netOutput|[Tt]ransport|esp_now|espNow"),
+    ("main",      r"^(setup|loop|renderFrame|pushOutputs|reportOutput|outputLoop|handleSerialCommand|readSerialCommands|printFrameStats|printMemory)\b"),
+]
+
+
+def collect(nm, elf):
+    """returns {subsystem: [flash, ram]} in bytes"""
+    out = subprocess.run([nm, "-S", "-C", "--size-sort", elf], capture_output=True, text=True).stdout
+    sizes = {name: [0, 0] for name, _ in SUBSYSTEMS}
+    sizes["framework"] = [0, 0]
+    for line in out.splitlines():
+        parts = line.split(None, 3)
+        if len(parts) < 4:
+            continue
+        size, kind, symbol = int(parts[1], 16), parts[2].lower(), parts[3]
+        group = next((name for name, pattern in SUBSYSTEMS if re.search(pattern, symbol)), "framework")
+        if kind in "trwv":
+            sizes[group][0] += size         # code, constants
+        elif kind == "d":
+            sizes[group][0] += size         # initialised data: in flash and copied to RAM
+            sizes[group][1] += size
+        elif kind in "bs":
+            sizes[group][1] += size
+    return sizes
+
+
+def report(source, target, env):
+    nm = env.subst("$CC").replace("gcc", "nm")     # e.g. riscv32-esp-elf-gcc -> riscv32-esp-elf-nm
+    sizes = collect(nm, str(target[0]))
+    print("%-10s %9s %9s" % ("subsystem", "flash", "RAM"))
+    for name, (flash, ram) in sizes.items():
+        print("%-10s %9d %9d" % (name, flash, ram))
+    print("%-10s %9d %9d" % ("total", sum(s[0] for s in sizes.values()), sum(s[1] for s in sizes.values())))
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report)
@@ -0,0 +1,46 @@
+#pragma once
+
+// Minimal host-side stand-in for the Arduino core, just enough for the header-only
+// receiver code (effect.hpp & co.) to compile in the "native" PlatformIO environment.
+// Time is simulated: tools advance it explicitly, so runs are deterministic.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <algorithm>
+
+namespace native {
+    // 64 bit like esp_timer, millis() and micros() wrap like on the chip (49 days / 71 min)
+    inline uint64_t simMicros = 0;
+
+    inline void setMillis(uint32_t ms) { simMicros = (uint64_t)ms * 1000; }
+    inline void advanceMillis(uint32_t ms) { simMicros += (uint64_t)ms * 1000; }
+    inline void advanceMicros(uint32_t us) { simMicros += us; }
+}
+
+inline uint32_t millis() { return native::simMicros / 1000; }
+inline uint32_t micros() { return native::simMicros; }
+
+using std::min;
+using std::max;
+
+class HardwareSerial {
+    public:
+    void begin(unsigned long) { }
+    void setTxBufferSize(size_t) { }
+    int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        va_start(args, fmt);
+        int ret = vprintf(fmt, args);
+        va_end(args);
+        return ret;
+    }
+    size_t print(const char *str) { return fputs(str, stdout) < 0 ? 0 : strlen(str); }
+    size_t println(const char *str = "") { return print(str) + print("\n"); }
+    int availableForWrite() { return 4096; }
+    void flush() { fflush(stdout); }
+    int available() { return 0; }
+    int read() { return -1; }
+};
+inline HardwareSerial Serial;
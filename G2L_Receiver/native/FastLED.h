@@ -0,0 +1,190 @@
+#pragma once
+
+// Host-side subset of FastLED (3.9.x) used by the receiver effects: CRGB/CHSV,
+// scale8 math and hsv2rgb_rainbow. The math mirrors FastLED's portable C
+// implementation (FASTLED_SCALE8_FIXED == 1), so colours match the firmware.
+
+#include <stdint.h>
+
+inline uint8_t scale8(uint8_t i, uint8_t scale) {
+    return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8;
+}
+
+inline uint8_t scale8_video(uint8_t i, uint8_t scale) {
+    return (((uint16_t)i * (uint16_t)scale) >> 8) + ((i && scale) ? 1 : 0);
+}
+
+inline uint8_t qadd8(uint8_t i, uint8_t j) {
+    unsigned int t = i + j;
+    return t > 255 ? 255 : t;
+}
+
+struct CHSV {
+    union {
+        struct {
+            union { uint8_t hue; uint8_t h; };
+            union { uint8_t saturation; uint8_t sat; uint8_t s; };
+            union { uint8_t value; uint8_t val; uint8_t v; };
+        };
+        uint8_t raw[3];
+    };
+
+    CHSV() = default;
+    constexpr CHSV(uint8_t ih, uint8_t is, uint8_t iv) : h(ih), s(is), v(iv) { }
+};
+
+struct CRGB {
+    union {
+        struct {
+            union { uint8_t r; uint8_t red; };
+            union { uint8_t g; uint8_t green; };
+            union { uint8_t b; uint8_t blue; };
+        };
+        uint8_t raw[3];
+    };
+
+    typedef enum {
+        Black       = 0x000000,
+        Blue        = 0x0000FF,
+        Cyan        = 0x00FFFF,
+        LightGrey   = 0xD3D3D3,
+        Magenta     = 0xFF00FF,
+        Orange      = 0xFFA500,
+        Red         = 0xFF0000,
+        White       = 0xFFFFFF,
+        Yellow      = 0xFFFF00,
+    } HTMLColorCode;
+
+    CRGB() = default;
+    constexpr CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) { }
+    constexpr CRGB(uint32_t colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) { }
+    constexpr CRGB(HTMLColorCode colorcode) : CRGB((uint32_t)colorcode) { }
+
+    uint8_t &operator[](uint8_t x) { return raw[x]; }
+    const uint8_t &operator[](uint8_t x) const { return raw[x]; }
+
+    CRGB &nscale8(uint8_t scaledown) {
+        r = ::scale8(r, scaledown);
+        g = ::scale8(g, scaledown);
+        b = ::scale8(b, scaledown);
+        return *this;
+    }
+
+    CRGB scale8(uint8_t scaledown) const {
+        CRGB out = *this;
+        return out.nscale8(scaledown);
+    }
+
+    CRGB &operator+=(const CRGB &rhs) {
+        r = qadd8(r, rhs.r);
+        g = qadd8(g, rhs.g);
+        b = qadd8(b, rhs.b);
+        return *this;
+    }
+};
+
+inline bool operator==(const CRGB &lhs, const CRGB &rhs) {
+    return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b;
+}
+
+inline bool operator!=(const CRGB &lhs, const CRGB &rhs) {
+    return !(lhs == rhs);
+}
+
+inline void hsv2rgb_rainbow(const CHSV &hsv, CRGB &rgb) {
+    const uint8_t hue = hsv.hue;
+    const uint8_t sat = hsv.sat;
+    uint8_t val = hsv.val;
+
+    uint8_t offset8 = (hue & 0x1F) << 3;
+    uint8_t third = scale8(offset8, (256 / 3));
+    uint8_t r, g, b;
+
+    if (!(hue & 0x80)) {
+        if (!(hue & 0x40)) {
+            if (!(hue & 0x20)) {            // R -> O
+                r = 255 - third;
+                g = third;
+                b = 0;
+            }
+            else {                          // O -> Y
+                r = 171;
+                g = 85 + third;
+                b = 0;
+            }
+        }
+        else {
+            if (!(hue & 0x20)) {            // Y -> G
+                uint8_t twothirds = scale8(offset8, ((256 * 2) / 3));
+                r = 171 - twothirds;
+                g = 170 + third;
+                b = 0;
+            }
+            else {                          // G -> A
+                r = 0;
+                g = 255 - third;
+                b = third;
+            }
+        }
+    }
+    else {
+        if (!(hue & 0x40)) {
+            if (!(hue & 0x20)) {            // A -> B
+                uint8_t twothirds = scale8(offset8, ((256 * 2) / 3));
+                r = 0;
+                g = 171 - twothirds;
+                b = 85 + twothirds;
+            }
+            else {                          // B -> P
+                r = third;
+                g = 0;
+                b = 255 - third;
+            }
+        }
+        else {
+            if (!(hue & 0x20)) {            // P -> K
+                r = 85 + third;
+                g = 0;
+                b = 171 - third;
+            }
+            else {                          // K -> R
+                r = 170 + third;
+                g = 0;
+                b = 85 - third;
+            }
+        }
+    }
+
+    if (sat != 255) {
+        if (sat == 0) {
+            r = 255; g = 255; b = 255;
+        }
+        else {
+            uint8_t desat = 255 - sat;
+            desat = scale8_video(desat, desat);
+            uint8_t satscale = 255 - desat;
+            r = scale8(r, satscale);
+            g = scale8(g, satscale);
+            b = scale8(b, satscale);
+            r += desat;
+            g += desat;
+            b += desat;
+        }
+    }
+
+    if (val != 255) {
+        val = scale8_video(val, val);
+        if (val == 0) {
+            r = 0; g = 0; b = 0;
+        }
+        else {
+            r = scale8(r, val);
+            g = scale8(g, val);
+            b = scale8(b, val);
+        }
+    }
+
+    rgb.r = r;
+    rgb.g = g;
+    rgb.b = b;
+}
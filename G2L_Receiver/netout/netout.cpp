@@ -0,0 +1,156 @@
+// Host-side check of the network DMX output (pio run -e netout -t exec). Renders the
+// effect engine into several universes, sends them with NetOutput as Art-Net and as
+// sACN to a UDP listener on localhost, and verifies every packet that arrives.
+
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+#include <fcntl.h>
+
+#include "effect.hpp"
+#include "fixtures.hpp"
+#include "netoutput.hpp"
+#include "output.hpp"
+
+static const int UNIVERSES = 4;
+static const int PIXELS_PER_UNIVERSE = 170;     // RGB fixtures, full universe
+static const int FRAMES = 2000;
+static const uint32_t FRAME_MS = 10;
+
+static CRGB pixels[UNIVERSES * PIXELS_PER_UNIVERSE];
+static OutputConverter<UNIVERSES * PIXELS_PER_UNIVERSE> dmxOutput(dmxCurve, DMX_BALANCE, DMX_DITHER);
+static uint8_t frames[UNIVERSES][DMX_UNIVERSE_SIZE];
+static DmxPatch patches[UNIVERSES];
+static PatchEntry patchEntries[UNIVERSES][PIXELS_PER_UNIVERSE];
+
+struct ListenerStats {
+    uint32_t data[UNIVERSES] = {0};
+    uint32_t syncs = 0;
+    uint32_t bad = 0;
+};
+
+static int openListener(uint16_t &port) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (sock < 0 || bind(sock, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("listener");
+        exit(1);
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(sock, (sockaddr *)&addr, &len);
+    port = ntohs(addr.sin_port);
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    fcntl(sock, F_SETFL, O_NONBLOCK);
+    return sock;
+}
+
+// checks one received packet against the frame it should carry
+static void checkPacket(NetProtocol protocol, const uint8_t *p, ssize_t len, ListenerStats &st) {
+    int u = -1;
+    const uint8_t *data = nullptr;
+    int dataLen = 0;
+
+    if (protocol == NET_ARTNET) {
+        if (len < 14 || memcmp(p, "Art-Net", 8) != 0) { st.bad++; return; }
+        uint16_t opcode = p[8] | (p[9] << 8);
+        if (opcode == 0x5200) { st.syncs++; return; }
+        if (opcode != 0x5000 || len < 18) { st.bad++; return; }
+        u = p[14] | (p[15] << 8);
+        dataLen = (p[16] << 8) | p[17];
+        data = p + 18;
+        if (len != 18 + dataLen) { st.bad++; return; }
+    }
+    else {
+        if (len < 49 || memcmp(p + 4, "ASC-E1.17", 9) != 0) { st.bad++; return; }
+        uint32_t vector = (p[18] << 24) | (p[19] << 16) | (p[20] << 8) | p[21];
+        if (vector == 0x00000008 && len == 49) { st.syncs++; return; }
+        if (vector != 0x00000004 || len < 126) { st.bad++; return; }
+        u = (p[113] << 8) | p[114];
+        int slots = (p[123] << 8) | p[124];
+        if (len != 125 + slots || p[125] != 0) { st.bad++; return; }
+        data = p + 126;
+        dataLen = slots - 1;
+    }
+
+    u -= 1;     // universes start at 1
+    if (u < 0 || u >= UNIVERSES || dataLen > DMX_UNIVERSE_SIZE - 1 || memcmp(data, frames[u] + 1, dataLen) != 0) {
+        st.bad++;
+        return;
+    }
+    st.data[u]++;
+}
+
+static void drainListener(int sock, NetProtocol protocol, ListenerStats &st) {
+    uint8_t buf[1024];
+    ssize_t len;
+    while ((len = recv(sock, buf, sizeof(buf), 0)) > 0) {
+        checkPacket(protocol, buf, len, st);
+    }
+}
+
+static bool run(NetProtocol protocol) {
+    uint16_t port;
+    int listener = openListener(port);
+
+    NetOutput net;
+    if (!net.begin(protocol, "127.0.0.1", port, UNIVERSES + 1)) {
+        fprintf(stderr, "NetOutput::begin failed\n");
+        return false;
+    }
+    for (int u = 0; u < UNIVERSES; u++) {
+        net.addUniverse(u + 1, frames[u], patches[u].size());
+    }
+
+    ListenerStats st;
+    uint64_t sendNs = 0;
+    native::setMillis(100000);
+    for (int f = 0; f < FRAMES; f++) {
+        native::advanceMillis(FRAME_MS);
+        // press a button now and then, in between the output settles and universes get skipped
+        if (f % 400 == 0) fx.trigger((f / 400) % effectsNum, BTN_PRESSED);
+        fx.loop(millis());
+        dmxOutput.convert(fx.frame(), pixels, fx.numPixels());
+        for (int u = 0; u < UNIVERSES; u++) {
+            patches[u].render(pixels, frames[u]);
+        }
+
+        auto t0 = std::chrono::steady_clock::now();
+        net.send(millis());
+        sendNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+
+        drainListener(listener, protocol, st);
+    }
+    drainListener(listener, protocol, st);
+    close(listener);
+
+    const NetOutput::Stats &ns = net.stats();
+    uint32_t received = 0;
+    printf("%s: sent %u, skipped %u, syncs %u, errors %u, %.1f us per frame\n", protocol == NET_ARTNET ? "Art-Net" : "sACN",
+        ns.sent, ns.skipped, ns.syncs, ns.errors, sendNs / 1000.0 / FRAMES);
+    for (int u = 0; u < UNIVERSES; u++) {
+        printf("  universe %d: %u packets\n", u + 1, st.data[u]);
+        received += st.data[u];
+    }
+    printf("  syncs received %u, bad packets %u\n", st.syncs, st.bad);
+
+    return st.bad == 0 && ns.errors == 0 && received + st.syncs == ns.sent;
+}
+
+int main() {
+    for (int u = 0; u < UNIVERSES; u++) {
+        for (int i = 0; i < PIXELS_PER_UNIVERSE; i++) {
+            patchEntries[u][i] = { (uint16_t)(1 + i * 3), (uint16_t)(u * PIXELS_PER_UNIVERSE + i), &PROFILE_RGB };
+        }
+        patches[u].init(patchEntries[u], PIXELS_PER_UNIVERSE, frames[u]);
+    }
+    fx.init(UNIVERSES * PIXELS_PER_UNIVERSE);
+
+    bool ok = run(NET_ARTNET);
+    ok = run(NET_SACN) && ok;
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+// Host-side replay of recorded button sessions (pio run -e replay, then run
+// .pio/build/replay/program). Feeds the events through the same ButtonTracker and
+// EffectEngine as the firmware on a simulated clock and writes every DMX frame to
+// a binary file, optionally comparing against a golden file from an earlier run.
+//
+// usage: program <recording> <out.dmx> [-r rate_hz] [-g golden.dmx] [-n repeats]
+//   recording: serial monitor capture containing the "rec ..." lines of "rec dump"
+
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+#include <stdlib.h>
+
+#include "effect.hpp"
+#include "buttons.hpp"
+#include "fixtures.hpp"
+#include "recorder.hpp"
+#include "output.hpp"
+
+static const uint32_t LEAD_IN = 1000;   // ms rendered before the first event
+static const uint32_t TAIL = 5000;      // ms rendered after the last event, lets the idle fade-up finish
+static const uint32_t RELEASE_CHECK_HOLD = 300;     // ms an effect is held at least in the release check
+static const uint32_t RELEASE_CHECK_SPREAD = 100;   // ms, further releases up to this much later, covers every strobe phase
+static const uint32_t HOLD_INTERVAL = 25;           // ms, same pacing as SEND_INTERVAL_HOLD on the button
+
+#pragma pack(push, 1)
+struct DmxFileHeader {
+    char magic[4];          // "G2LD"
+    uint16_t version;
+    uint16_t frameSize;     // bytes of DMX data per frame, incl. start code
+    uint32_t framePeriodUs;
+    uint32_t frameCount;
+};
+#pragma pack(pop)
+// followed by frameCount * (uint32_t time_ms, uint8_t data[frameSize])
+
+static void triggerEffect(int buttonId, int btnState) {
+    fx.trigger(buttonId, btnState);
+}
+
+static std::vector<ButtonEvent> loadRecording(const char *path) {
+    std::vector<ButtonEvent> events;
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    char line[256];
+    ButtonEvent ev;
+    while (fgets(line, sizeof(line), f)) {
+        if (parseRecordLine(line, ev)) {
+            events.push_back(ev);
+        }
+    }
+    fclose(f);
+    return events;
+}
+
+static DmxPatch dmxPatch;
+static uint8_t dmxFrame[DMX_UNIVERSE_SIZE];
+static CRGB pixels[DMX_MAX_PIXELS];
+static OutputConverter<DMX_MAX_PIXELS> dmxOutput(dmxCurve, DMX_BALANCE, DMX_DITHER);
+
+// renders the whole session, frames are appended as (time, payload). The clock runs at the
+// recorded millis(), so frame times match the capture. Returns the number of events applied
+static size_t replay(const std::vector<ButtonEvent> &events, uint32_t periodUs, std::vector<uint8_t> &out, uint32_t &frameCount) {
+    ButtonTracker buttons(triggerEffect);
+    dmxOutput.reset();
+
+    uint64_t first = events.front().time;
+    uint64_t startUs = (first > LEAD_IN ? first - LEAD_IN : 0) * 1000;
+    uint64_t endUs = ((uint64_t)events.back().time + TAIL) * 1000;
+    size_t next = 0;
+    frameCount = 0;
+    out.clear();
+
+    for (uint64_t t = startUs; t < endUs; t += periodUs) {
+        native::simMicros = t;
+        uint32_t now = millis();
+        // same order as the firmware loop: queued events, stuck buttons, render
+        while (next < events.size() && events[next].time <= now) {
+            buttons.apply(events[next++]);
+        }
+        buttons.checkStuck(now);
+        fx.loop(now);
+        dmxOutput.convert(fx.frame(), pixels, fx.numPixels());
+        dmxPatch.render(pixels, dmxFrame);
+
+        const uint8_t *time = (const uint8_t *)&now;
+        out.insert(out.end(), time, time + sizeof(now));
+        out.insert(out.end(), dmxFrame, dmxFrame + dmxPatch.size());
+        frameCount++;
+    }
+    return next;
+}
+
+static void checkFrame(uint32_t periodUs) {
+    native::advanceMicros(periodUs);
+    fx.loop(millis());
+}
+
+// presses effect e, holds it for hold ms and releases it. Once it has run out the output
+// has to stay dark until the idle fade-up starts, a released effect must not leave its
+// last layer in the composite. Returns false if it doesn't
+static bool checkRelease(int e, uint32_t hold, uint32_t periodUs) {
+    uint32_t pressed = millis(), lastHold = pressed;
+    fx.trigger(e, BTN_PRESSED, pressed);
+    while (millis() - pressed < hold) {
+        checkFrame(periodUs);
+        if (millis() - lastHold >= HOLD_INTERVAL) {
+            fx.trigger(e, BTN_HOLD, millis());
+            lastHold = millis();
+        }
+    }
+
+    uint32_t released = millis(), lastRun = released;
+    fx.trigger(e, BTN_RELEASED, released);
+    bool dark = true;
+    while (millis() - released < TAIL) {
+        checkFrame(periodUs);
+        if (fx.effectRunning()) {
+            lastRun = millis();
+            continue;
+        }
+        if (millis() - lastRun > AFTER_EFFECT_PAUSE) break;    // idle fade-up from here
+        const RGB16 *out = fx.frame();
+        for (int i = 0; i < fx.numPixels(); i++) dark &= !(out[i].r | out[i].g | out[i].b);
+        if (!dark) {
+            printf("release check: effect %d held %u ms still lit %u ms after release\n", e, hold, millis() - released);
+            break;
+        }
+    }
+    while (millis() - lastRun < AFTER_EFFECT_PAUSE + AFTER_EFFECT_FADE_UP) checkFrame(periodUs);
+    return dark;
+}
+
+// every effect released at several points of its animation (all strobe phases). Returns
+// the number of failed releases
+static int checkReleases(uint32_t periodUs) {
+    for (int e = 0; e < effectsNum; e++) {
+        fx.trigger(e, BTN_RELEASED, millis());
+    }
+    while (fx.effectRunning()) checkFrame(periodUs);
+
+    int checks = 0, failed = 0;
+    for (int e = 0; e < effectsNum; e++) {
+        for (uint32_t hold = RELEASE_CHECK_HOLD; hold < RELEASE_CHECK_HOLD + RELEASE_CHECK_SPREAD; hold += periodUs / 1000 + 1) {
+            failed += !checkRelease(e, hold, periodUs);
+            checks++;
+        }
+    }
+    printf("release check: %d of %d releases go dark\n", checks - failed, checks);
+    return failed;
+}
+
+static void compareGolden(const char *path, const std::vector<uint8_t> &frames, uint32_t frameCount) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    DmxFileHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, "G2LD", 4) || hdr.frameSize != dmxPatch.size()) {
+        fprintf(stderr, "%s: not a compatible DMX frame file\n", path);
+        exit(1);
+    }
+    std::vector<uint8_t> golden(frames.size());
+    size_t len = fread(golden.data(), 1, golden.size(), f);
+    fclose(f);
+
+    size_t recSize = sizeof(uint32_t) + dmxPatch.size();
+    uint32_t diffs = 0;
+    for (size_t i = 0; i < frameCount && (i + 1) * recSize <= len; i++) {
+        if (memcmp(&frames[i * recSize], &golden[i * recSize], recSize)) {
+            if (!diffs) {
+                uint32_t time;
+                memcpy(&time, &frames[i * recSize], sizeof(time));
+                printf("first difference in frame %zu (t=%u ms)\n", i, time);
+            }
+            diffs++;
+        }
+    }
+    if (hdr.frameCount != frameCount) {
+        printf("frame count differs: %u golden, %u now\n", hdr.frameCount, frameCount);
+    }
+    printf("golden compare: %u of %u frames differ\n", diffs, frameCount);
+    if (diffs || hdr.frameCount != frameCount) exit(2);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <recording> <out.dmx> [-r rate_hz] [-g golden.dmx] [-n repeats]\n", argv[0]);
+        return 1;
+    }
+    uint32_t rate = 100;
+    const char *golden = nullptr;
+    int repeats = 1;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-r")) rate = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-g")) golden = argv[i + 1];
+        else if (!strcmp(argv[i], "-n")) repeats = atoi(argv[i + 1]);
+    }
+
+    if (!dmxPatch.init(fixturePatch, fixturePatchNum, dmxFrame)) {
+        fprintf(stderr, "fixture patch overlaps or exceeds the universe\n");
+        return 1;
+    }
+    fx.init(dmxPatch.numPixels());
+
+    std::vector<ButtonEvent> events = loadRecording(argv[1]);
+    if (events.empty()) {
+        fprintf(stderr, "%s: no \"rec\" lines found\n", argv[1]);
+        return 1;
+    }
+    printf("%zu events, %.1f s session\n", events.size(), (events.back().time - events.front().time) / 1000.0);
+
+    uint32_t periodUs = 1000000 / rate;
+    std::vector<uint8_t> frames;
+    uint32_t frameCount = 0;
+
+    // repeated runs are only there to get a stable throughput number. Effects keep some
+    // state between runs (palette, odd/even), so only the first run goes to the file.
+    auto t0 = std::chrono::steady_clock::now();
+    size_t applied = replay(events, periodUs, frames, frameCount);
+    std::vector<uint8_t> scratch;
+    for (int r = 1; r < repeats; r++) {
+        replay(events, periodUs, scratch, frameCount);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double wallS = std::chrono::duration<double>(t1 - t0).count();
+    double simS = (double)frameCount * periodUs / 1e6 * repeats;
+    printf("%u frames at %u Hz, %.0f frames/s, %.0fx real time\n", frameCount, rate, frameCount * repeats / wallS, simS / wallS);
+
+    FILE *f = fopen(argv[2], "wb");
+    if (!f) {
+        perror(argv[2]);
+        return 1;
+    }
+    DmxFileHeader hdr = { { 'G', '2', 'L', 'D' }, 1, dmxPatch.size(), periodUs, frameCount };
+    fwrite(&hdr, sizeof(hdr), 1, f);
+    fwrite(frames.data(), 1, frames.size(), f);
+    fclose(f);
+
+    // events out of time order (a capture spanning a millis() wrap) never get their turn
+    if (applied != events.size()) {
+        printf("only %zu of %zu events applied, the recording isn't in time order\n", applied, events.size());
+        return 4;
+    }
+
+    // after the recorded session, so it doesn't change the frames written above
+    if (checkReleases(periodUs)) return 3;
+    if (golden) {
+        compareGolden(golden, frames, frameCount);
+    }
+    return 0;
+}
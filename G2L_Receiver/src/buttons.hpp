@@ -0,0 +1,287 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+#include "events.hpp"
+
+static const int RX_TIMEOUT = 200;     // ms, timeout after which button is assumed released
+static const int RX_DEDUP_TIME = 50;   // ms, until next v1 packet of same type is accepted again
+static const int SEQ_STALE_WINDOW = 64; // packets a v2 sequence number may go back without being a button restart
+static const int MAX_PRESS_GAP = 1000;  // larger press count jumps are a restart, not lost presses
+
+static const int MAX_BUTTONS = 256;
+static const int BUTTON_HASH_SIZE = 2 * MAX_BUTTONS;   // power of two, at most half full
+
+// MAC address -> button id. Open addressing hash table, so the lookup per packet doesn't
+// depend on the number of paired buttons. Ids are handed out in order and stay stable,
+// the button / effect association is done via the id.
+class ButtonRegistry {
+    public:
+    ButtonRegistry() { clear(); }
+
+    void clear() {
+        _count = 0;
+        for (int i = 0; i < BUTTON_HASH_SIZE; i++) _slots[i] = -1;
+    }
+
+    // -1 if unknown
+    int find(const uint8_t *mac) const {
+        for (uint32_t slot = hash(mac);; slot = (slot + 1) & (BUTTON_HASH_SIZE - 1)) {
+            int id = _slots[slot];
+            if (id < 0) return -1;
+            if (memcmp(_macs[id], mac, 6) == 0) return id;
+        }
+    }
+
+    // id of the (possibly new) button, -1 if the registry is full
+    int add(const uint8_t *mac) {
+        int id = find(mac);
+        if (id >= 0) return id;
+        if (_count >= MAX_BUTTONS) return -1;
+
+        id = _count++;
+        memcpy(_macs[id], mac, 6);
+        uint32_t slot = hash(mac);
+        while (_slots[slot] >= 0) slot = (slot + 1) & (BUTTON_HASH_SIZE - 1);
+        _slots[slot] = id;
+        return id;
+    }
+
+    int count() const { return _count; }
+    const uint8_t *mac(int id) const { return _macs[id]; }
+    const uint8_t *macs() const { return _macs[0]; }    // count() * 6 bytes, e.g. for storing
+
+    protected:
+    // FNV-1a, vendor prefixes are mostly equal so all bytes have to go in
+    static uint32_t hash(const uint8_t *mac) {
+        uint32_t h = 2166136261u;
+        for (int i = 0; i < 6; i++) {
+            h = (h ^ mac[i]) * 16777619u;
+        }
+        return (h ^ (h >> 16)) & (BUTTON_HASH_SIZE - 1);
+    }
+
+    uint8_t _macs[MAX_BUTTONS][6];
+    int16_t _slots[BUTTON_HASH_SIZE];
+    int _count = 0;
+};
+
+// Receive side button state: turns the stream of received (and repeated) packets into
+// clean pressed/hold/released events. Runs on the render loop only.
+// v2 packets are deduplicated by their sequence number, and the press counter tells
+// exactly when a pressed or released packet got lost. v1 packets go through the old
+// time based deduplication.
+// Pressed buttons sit in a timer wheel ordered by their release timeout, so the stuck
+// button check only looks at buttons that are actually due.
+class ButtonTracker {
+    public:
+    typedef void (*EventHandler)(int buttonId, int btnState);
+
+    // per button, v2 packets only
+    struct LinkStats {
+        uint32_t packets = 0;
+        uint32_t duplicates = 0;
+        uint32_t lost = 0;              // sequence gaps
+        uint32_t lostPresses = 0;       // whole presses that never arrived
+        uint32_t missedPresses = 0;     // pressed packet lost, recovered from a later one
+        uint32_t missedReleases = 0;    // released packet lost, recovered from the next press
+    };
+
+    static const int WHEEL_TICK = 16;       // ms per wheel slot
+    static const int WHEEL_SIZE = 32;       // slots, must cover RX_TIMEOUT
+
+    ButtonTracker(EventHandler handler) : _handler(handler) {
+        static_assert(WHEEL_TICK * (WHEEL_SIZE - 1) > RX_TIMEOUT, "timer wheel too short for RX_TIMEOUT");
+        for (int i = 0; i < MAX_BUTTONS; i++) {
+            _lastState[i] = BTN_RELEASED;
+            _lastReceived[i] = 0;
+            _next[i] = _prev[i] = -1;
+            _synced[i] = false;
+        }
+        for (int i = 0; i < WHEEL_SIZE; i++) _wheel[i] = -1;
+    }
+
+    // applies a received packet
+    void apply(const ButtonEvent &ev) {
+        int buttonId = ev.buttonId;
+        if (buttonId >= MAX_BUTTONS) return;
+        if (ev.version >= G2L_PROTOCOL_V2) {
+            if (!applySequenced(ev)) return;
+        }
+        else {
+            // Serial.printf("State: %d (%d), Time: %d (%d)\n", ev.btnState, _lastState[buttonId], ev.time, _lastReceived[buttonId]);
+
+            // deduplicate multiple sent events (except hold events)
+            if (_lastState[buttonId] != ev.btnState || ev.time - _lastReceived[buttonId] > RX_DEDUP_TIME || ev.btnState == BTN_HOLD) {
+                // inject "pressed" event when first newly received event is "hold" (missed "pressed" transmission)
+                if (_lastState[buttonId] == BTN_RELEASED && ev.btnState == BTN_HOLD) {
+                    _handler(buttonId, BTN_PRESSED);
+                }
+                _handler(buttonId, ev.btnState);
+            }
+        }
+
+        _lastReceived[buttonId] = ev.time;
+        _lastState[buttonId] = ev.btnState;
+
+        unlink(buttonId);
+        if (ev.btnState == BTN_PRESSED || ev.btnState == BTN_HOLD) {
+            link(buttonId, deadline(buttonId));
+        }
+    }
+
+    // if only the pressed/held, but no released events got received, release the button after a timeout
+    void checkStuck(uint32_t now) {
+        uint32_t nowTick = now / WHEEL_TICK;
+        if (!_wheelStarted) {
+            _wheelTick = nowTick;
+            _wheelStarted = true;
+        }
+        // visit every slot since the last call (all of them after a long pause). The current
+        // slot is visited again next time, it may hold deadlines later in this tick
+        uint32_t ticks = nowTick - _wheelTick;
+        if (ticks >= WHEEL_SIZE) ticks = WHEEL_SIZE - 1;
+        for (uint32_t t = nowTick - ticks; t != nowTick + 1; t++) {
+            int id = _wheel[t & (WHEEL_SIZE - 1)];
+            while (id >= 0) {
+                int next = _next[id];
+                if ((int32_t)(now - deadline(id)) >= 0) {
+                    unlink(id);
+                    _lastState[id] = BTN_RELEASED;
+                    _handler(id, BTN_RELEASED);
+                }
+                id = next;
+            }
+        }
+        _wheelTick = nowTick;
+    }
+
+    uint8_t state(int buttonId) const { return _lastState[buttonId]; }
+    uint32_t lastReceived(int buttonId) const { return _lastReceived[buttonId]; }
+    const LinkStats &linkStats(int buttonId) const { return _link[buttonId]; }
+
+    protected:
+    // false if the packet is a repeat or older than the last one
+    bool applySequenced(const ButtonEvent &ev) {
+        int id = ev.buttonId;
+        LinkStats &ls = _link[id];
+        bool newPress = true;
+        if (_synced[id]) {
+            int16_t diff = ev.seq - _lastSeq[id];
+            if (diff <= 0 && diff > -SEQ_STALE_WINDOW) {
+                ls.duplicates++;
+                return false;
+            }
+            if (diff > 1) ls.lost += diff - 1;
+
+            uint16_t pressGap = ev.pressCount - _lastPress[id];
+            newPress = pressGap != 0;
+            if (pressGap > 1 && pressGap < MAX_PRESS_GAP) ls.lostPresses += pressGap - 1;
+        }
+        ls.packets++;
+        _synced[id] = true;
+        _lastSeq[id] = ev.seq;
+        _lastPress[id] = ev.pressCount;
+
+        if (newPress && _lastState[id] != BTN_RELEASED) {
+            ls.missedReleases++;
+            _handler(id, BTN_RELEASED);
+            _lastState[id] = BTN_RELEASED;
+        }
+        // pressed packet lost, or released by the timeout while still held
+        if (_lastState[id] == BTN_RELEASED && (ev.btnState == BTN_HOLD || (newPress && ev.btnState == BTN_RELEASED))) {
+            if (newPress) ls.missedPresses++;
+            _handler(id, BTN_PRESSED);
+            _lastState[id] = BTN_PRESSED;
+        }
+        if (ev.btnState != _lastState[id] || ev.btnState == BTN_HOLD) {
+            _handler(id, ev.btnState);
+        }
+        return true;
+    }
+
+    uint32_t deadline(int id) const { return _lastReceived[id] + RX_TIMEOUT + 1; }
+
+    void link(int id, uint32_t time) {
+        // deadlines that already passed (old queued events) go into the current slot
+        uint32_t tick = time / WHEEL_TICK;
+        if (_wheelStarted && (int32_t)(tick - _wheelTick) < 0) tick = _wheelTick;
+        int slot = tick & (WHEEL_SIZE - 1);
+        _slotOf[id] = slot;
+        _prev[id] = -1;
+        _next[id] = _wheel[slot];
+        if (_next[id] >= 0) _prev[_next[id]] = id;
+        _wheel[slot] = id;
+        _linked[id] = true;
+    }
+
+    void unlink(int id) {
+        if (!_linked[id]) return;
+        if (_prev[id] >= 0) _next[_prev[id]] = _next[id];
+        else _wheel[_slotOf[id]] = _next[id];
+        if (_next[id] >= 0) _prev[_next[id]] = _prev[id];
+        _next[id] = _prev[id] = -1;
+        _linked[id] = false;
+    }
+
+    EventHandler _handler;
+
+    // per button state, struct of arrays
+    uint32_t _lastReceived[MAX_BUTTONS];
+    uint8_t _lastState[MAX_BUTTONS];
+    int16_t _next[MAX_BUTTONS], _prev[MAX_BUTTONS];
+    uint8_t _slotOf[MAX_BUTTONS];
+    bool _linked[MAX_BUTTONS] = {};
+    uint16_t _lastSeq[MAX_BUTTONS];
+    uint16_t _lastPress[MAX_BUTTONS];
+    bool _synced[MAX_BUTTONS];
+    LinkStats _link[MAX_BUTTONS];
+
+    int16_t _wheel[WHEEL_SIZE];     // first button per slot
+    uint32_t _wheelTick = 0;
+    bool _wheelStarted = false;
+};
+
+// Render loop side of the packet path, the firmware and the load test both run it: resolves
+// the sender of each queued event through the registry and hands the event to the tracker.
+// onUnknown gets events of unregistered senders and returns the id it gave the sender
+// (pairing) or -1 to drop the event. onResolved sees every event of a known button, check-ins
+// included, and returns false to keep it from the tracker. Both may be null.
+class ButtonEventDispatcher {
+    public:
+    typedef int (*UnknownHandler)(const ButtonEvent &ev);
+    typedef bool (*ResolvedHandler)(const ButtonEvent &ev);
+
+    ButtonEventDispatcher(ButtonEventQueue &queue, const ButtonRegistry &registry, ButtonTracker &tracker,
+        UnknownHandler onUnknown = nullptr, ResolvedHandler onResolved = nullptr)
+        : _queue(queue), _registry(registry), _tracker(tracker), _onUnknown(onUnknown), _onResolved(onResolved) {}
+
+    void process() {
+        ButtonEvent ev;
+        while (_queue.pop(ev)) {
+            int buttonId = _registry.find(ev.mac);
+            if (buttonId < 0 && _onUnknown) buttonId = _onUnknown(ev);
+            if (buttonId < 0) continue;
+
+            ev.buttonId = buttonId;
+            if (_onResolved && !_onResolved(ev)) continue;
+            _current = &ev;
+            _tracker.apply(ev);
+            _current = nullptr;
+        }
+    }
+
+    // the packet the tracker is applying, for the event handler. Null for the tracker's own
+    // events (stuck buttons)
+    const ButtonEvent *current() const { return _current; }
+
+    protected:
+    ButtonEventQueue &_queue;
+    const ButtonRegistry &_registry;
+    ButtonTracker &_tracker;
+    UnknownHandler _onUnknown;
+    ResolvedHandler _onResolved;
+    const ButtonEvent *_current = nullptr;
+};
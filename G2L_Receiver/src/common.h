@@ -6,14 +6,54 @@ enum BtnState {
     BTN_PRESSED = 1,
     BTN_HOLD,
     BTN_RELEASED,
+    BTN_CHECKIN,    // periodic "still alive" from an idle button, battery report only
 };
 
 const uint16_t G2L_PREAMBLE = '2G'; // "G2" in network byte order
 
+const uint8_t G2L_PROTOCOL_V2 = 2;
+const uint8_t G2L_PROTOCOL_V3 = 3;
+
+const uint16_t G2L_BEACON_PREAMBLE = 'SG';  // "GS", clock beacon between receivers
+
+// batVolt is the battery in mV / 4: the button reads it through a 1:2 divider and halves
+// the pin voltage again, so it fits the field with room to spare
+const uint16_t G2L_BAT_VOLT_FACTOR = 4;
+
 #pragma pack(push, 1)
+// v1, still accepted by the receiver
 typedef struct {
     uint16_t preamble;
     uint8_t btnState;
-    uint16_t batVolt;   // mV
+    uint16_t batVolt;   // mV / G2L_BAT_VOLT_FACTOR
 } payload_t;
+
+// v2 appends to v1. Repeats of a packet carry the same sequence number, so the receiver
+// can drop them exactly and count the ones that got lost in between
+typedef struct {
+    uint16_t preamble;
+    uint8_t btnState;
+    uint16_t batVolt;   // mV / G2L_BAT_VOLT_FACTOR
+    uint8_t version;    // G2L_PROTOCOL_V2
+    uint16_t seq;       // +1 per packet (not per repeat), check-ins don't count
+    uint16_t pressCount;// +1 per press, all packets of a press carry the same value
+} payload_v2_t;
+
+// v3 appends the button's part of the press latency
+typedef struct {
+    uint16_t preamble;
+    uint8_t btnState;
+    uint16_t batVolt;   // mV / G2L_BAT_VOLT_FACTOR
+    uint8_t version;    // G2L_PROTOCOL_V3
+    uint16_t seq;
+    uint16_t pressCount;
+    uint16_t txDelay;   // us from the button edge to handing this packet to the radio, pressed only
+} payload_v3_t;
+
+// show clock of the sync master, broadcast to the other receivers (see showclock.hpp)
+typedef struct {
+    uint16_t preamble;  // G2L_BEACON_PREAMBLE
+    uint8_t seq;        // +1 per beacon
+    uint64_t showUs;    // master show time when handing the beacon to the radio
+} beacon_t;
 #pragma pack(pop)
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <FastLED.h>
+
+// Layer blending for the effect engine. Layers are rendered in 8 bit CRGB, the
+// composited frame keeps 16 bits per channel, so layer alphas and the background fade
+// don't throw away the low end. Each output reduces it to 8 bit with its own curve
+// (see output.hpp).
+
+struct RGB16 {
+    uint16_t r, g, b;
+};
+
+enum BlendMode : uint8_t {
+    BLEND_ALPHA,        // alpha-over: dst * (1 - a) + src * a
+    BLEND_ADD,          // dst + src * a, saturating
+    BLEND_MAX,          // HTP: per channel max(dst, src * a)
+    BLEND_MULTIPLY,     // dst * lerp(1, src, a)
+};
+
+static const uint16_t ALPHA16_MAX = 0xFFFF;
+
+// (v * (a + 1)) >> 16, a = ALPHA16_MAX keeps v
+inline uint16_t scale16(uint16_t v, uint16_t a) { return ((uint32_t)v * (a + 1)) >> 16; }
+inline uint16_t expand8(uint8_t v) { return v * 257; }     // 255 -> 65535
+
+inline RGB16 expandRGB(const CRGB &c) { return { expand8(c.r), expand8(c.g), expand8(c.b) }; }
+inline RGB16 scaleRGB(const RGB16 &c, uint16_t a) { return { scale16(c.r, a), scale16(c.g, a), scale16(c.b, a) }; }
+
+inline uint16_t add16(uint16_t a, uint16_t b) {
+    uint32_t sum = a + b;
+    return sum > 0xFFFF ? 0xFFFF : sum;
+}
+
+// blend a whole layer into dst with the given layer alpha
+inline void blendLayer(RGB16 *dst, const CRGB *src, size_t n, uint16_t alpha, BlendMode mode) {
+    if (alpha == 0) return;
+
+    switch (mode) {
+        case BLEND_ALPHA:
+            if (alpha == ALPHA16_MAX) {
+                for (size_t i = 0; i < n; i++) dst[i] = expandRGB(src[i]);
+            }
+            else {
+                // scale16(d, 1-a) + scale16(s, a) never exceeds 0xFFFF, no saturation needed
+                uint16_t inv = ALPHA16_MAX - alpha;
+                for (size_t i = 0; i < n; i++) {
+                    RGB16 s = scaleRGB(expandRGB(src[i]), alpha), d = scaleRGB(dst[i], inv);
+                    dst[i] = { (uint16_t)(d.r + s.r), (uint16_t)(d.g + s.g), (uint16_t)(d.b + s.b) };
+                }
+            }
+            break;
+        case BLEND_ADD:
+            for (size_t i = 0; i < n; i++) {
+                RGB16 s = scaleRGB(expandRGB(src[i]), alpha);
+                dst[i] = { add16(dst[i].r, s.r), add16(dst[i].g, s.g), add16(dst[i].b, s.b) };
+            }
+            break;
+        case BLEND_MAX:
+            for (size_t i = 0; i < n; i++) {
+                RGB16 s = scaleRGB(expandRGB(src[i]), alpha);
+                dst[i] = { std::max(dst[i].r, s.r), std::max(dst[i].g, s.g), std::max(dst[i].b, s.b) };
+            }
+            break;
+        case BLEND_MULTIPLY: {
+            // lerp the multiplier towards white for partial alpha
+            uint16_t white = scale16(ALPHA16_MAX, ALPHA16_MAX - alpha);
+            for (size_t i = 0; i < n; i++) {
+                RGB16 s = scaleRGB(expandRGB(src[i]), alpha);
+                dst[i] = { scale16(dst[i].r, white + s.r), scale16(dst[i].g, white + s.g), scale16(dst[i].b, white + s.b) };
+            }
+            break;
+        }
+    }
+}
@@ -2,22 +2,37 @@
 
 #include <Arduino.h>
 #include <FastLED.h>
+#include <array>
+#include <tuple>
 
 #include "common.h"
+#include "rainbow.hpp"
+#include "compositor.hpp"
+#include "palette.hpp"
 
 static const int RAINBOW_PERIOD = 5000;         // ms, how long a full rainbow revolution should last
 static const int BASE_BRIGHTNESS = 64;
 static const int AFTER_EFFECT_PAUSE = 1000;     // ms, time
 static const int AFTER_EFFECT_FADE_UP = 3000;
 
-static const CRGB palette[][2] = {
-    { CRGB::Cyan,       CRGB::Orange    },
-    { CRGB::Magenta,    CRGB::Cyan      },
-    { CRGB::Orange,     CRGB::Red       },
-    { CRGB::Blue,       CRGB::LightGrey },
-    { CRGB::Yellow,     CRGB::Magenta   },
+// size of the engine's static buffers, the host tools raise it with -DFX_MAX_PIXELS
+#ifndef FX_MAX_PIXELS
+#define FX_MAX_PIXELS 512       // one pixel per DMX channel
+#endif
+
+static const int PALETTE_FADE_TIME = 1500;     // ms, crossfade to the next palette
+
+// gradients, FXOddEven shows both ends on its two lights, FXPaletteWave the whole gradient
+static const Palette palettes[] = {
+    { 2, { { 0, CRGB::Cyan },       { 255, CRGB::Orange } } },
+    { 2, { { 0, CRGB::Magenta },    { 255, CRGB::Cyan } } },
+    { 2, { { 0, CRGB::Orange },     { 255, CRGB::Red } } },
+    { 2, { { 0, CRGB::Blue },       { 255, CRGB::LightGrey } } },
+    { 2, { { 0, CRGB::Yellow },     { 255, CRGB::Magenta } } },
+    { 3, { { 0, CRGB::Red },        { 128, CRGB::Orange },  { 255, CRGB::Yellow } } },
+    { 3, { { 0, CRGB::Blue },       { 128, CRGB::Magenta }, { 255, CRGB::Cyan } } },
 };
-static const int paletteNum = sizeof(palette) / sizeof(palette[0]); 
+static const int palettesNum = sizeof(palettes) / sizeof(palettes[0]);
 
 
 class Effect {
@@ -25,34 +40,41 @@ class Effect {
     Effect(uint32_t attack = 0, uint32_t sustain = 1000, uint32_t release = 0, bool hasHold = false) 
         : _attack(attack), _sustain(sustain), _release(release), _hasHold(hasHold) { }
 
-    void init(uint8_t numPixels = 2) { _numPixels = numPixels; }
-    virtual void start() { _started = _held = millis(); };
-    virtual void hold() { _held = millis(); }
-    virtual void stop() { _started = 0; };
+    void init(uint16_t numPixels = 2) { _numPixels = numPixels; }
+    // now: the engine's clock (the show clock on the receiver), the same one frames are rendered with
+    virtual void start(uint32_t now) { _started = _held = now; };
+    virtual void hold(uint32_t now) { _held = now; }
+    virtual void stop() { _started = _alpha = 0; };
     bool running() { return !!_started; }
-    uint8_t alpha() { return _alpha; }
+    uint16_t alpha() { return _alpha; }   // 0..ALPHA16_MAX
+    BlendMode blendMode() { return _blendMode; }
+    void setBlendMode(BlendMode mode) { _blendMode = mode; }
+
+    // renders one frame for n pixels, everything is evaluated at the same time `now`
+    virtual void renderFrame(CRGB *out, size_t n, uint32_t now) {
+        calcAlpha(now);
+        fill(out, n, CRGB::Black);
+    }
 
-    virtual CRGB render(int idx) {
-        if (idx == 0) {
-            calcAlpha(_hasHold ? _held : _started);
-        }
-        return CRGB::Black;
+    // envelope, once per frame
+    void calcAlpha(uint32_t now) {
+        calcAlpha(_hasHold ? _held : _started, now);
     }
 
-    void calcAlpha(uint32_t timingBase) {
+    void calcAlpha(uint32_t timingBase, uint32_t now) {
         if (!_started) {
             _alpha = 0;
             return;
         }
-        uint32_t runtime = millis() - timingBase;
+        uint32_t runtime = now - timingBase;
         if (runtime < _attack) {
-            _alpha = runtime * 255 / _attack;
+            _alpha = (uint64_t)runtime * ALPHA16_MAX / _attack;
         }
         else if (runtime < _attack + _sustain) {
-            _alpha = UINT8_MAX;
+            _alpha = ALPHA16_MAX;
         }
         else if (runtime < _attack + _sustain + _release) {
-            _alpha = 255 - ((runtime - _attack - _sustain) * 255 / _release);
+            _alpha = ALPHA16_MAX - ((uint64_t)(runtime - _attack - _sustain) * ALPHA16_MAX / _release);
         }
         else {
             // automatically disable effect when any ASR value is set
@@ -61,35 +83,37 @@ class Effect {
                 _started = 0;
             }
             else {
-                _alpha = 255;
+                _alpha = ALPHA16_MAX;
             }
         }
     }
 
     protected:
+    static void fill(CRGB *out, size_t n, CRGB color) {
+        for (size_t i = 0; i < n; i++) out[i] = color;
+    }
+
     uint32_t _attack, _sustain, _release;   // in ms
     bool _hasHold;
-    uint8_t _numPixels;
+    uint16_t _numPixels;
     uint32_t _started = 0, _held = 0;
-    uint8_t _alpha = 0;
+    uint16_t _alpha = 0;
+    BlendMode _blendMode = BLEND_MAX;     // how this effect's layer is combined with the layers below
 };
 
 class FXStrobe : public Effect {
     public:
     FXStrobe() : Effect(0, 100, 0, true) { }
-    CRGB render(int idx) override {
-        Effect::render(idx);
-        if (_alpha != 0) {
-            bool on = (((millis() / _strobeCycle) - _startCycle) % 3 == 0);
-            return on ? CRGB::White : CRGB::Black;
-        }
-        return CRGB::Black;
+    void renderFrame(CRGB *out, size_t n, uint32_t now) override {
+        calcAlpha(now);
+        bool on = _alpha != 0 && (((now / _strobeCycle) - _startCycle) % 3 == 0);
+        fill(out, n, on ? CRGB::White : CRGB::Black);
     }
 
-    void start() override {
-        Effect::start();
-        // _startInverted = (millis() / _strobeCycle) % 2;
-        _startCycle = (millis() / _strobeCycle) % 3;
+    void start(uint32_t now) override {
+        Effect::start(now);
+        // _startInverted = (now / _strobeCycle) % 2;
+        _startCycle = (now / _strobeCycle) % 3;
     }
 
     uint32_t _strobeCycle = 20;  // ms, length of on interval
@@ -101,67 +125,65 @@ class FXRainbowFlash : public Effect {
     public:
     FXRainbowFlash() : Effect(0, 50, 350, true) { }
     void stop() override {} // don't stop when button is released
-    CRGB render(int idx) override {
-        Effect::render(idx);
+    void renderFrame(CRGB *out, size_t n, uint32_t now) override {
+        calcAlpha(now);
 
-        // if (idx == _numPixels - 1) {
-        //     if (_alpha < BASE_BRIGHTNESS) {
-        //         Effect::stop(); // stop effect when background brightness got reached (avoids steppy fade look)
-        //     }
+        // if (_alpha < BASE_BRIGHTNESS) {
+        //     Effect::stop(); // stop effect when background brightness got reached (avoids steppy fade look)
         // }
 
-        uint32_t pixelOffset = idx * (RAINBOW_PERIOD / _numPixels);
-        CHSV hsv = CHSV(((millis() + pixelOffset) % RAINBOW_PERIOD) * 255 / RAINBOW_PERIOD, 240, 255);
-        CRGB rgb;
-        hsv2rgb_rainbow(hsv, rgb);
-        return rgb;
+        // rainbow phase gets updated by the engine for this frame
+        for (size_t i = 0; i < n; i++) {
+            out[i] = rainbow.color(i);
+        }
     }
 };
 
 class FXOddEven : public Effect {
     public:
     FXOddEven() : Effect(0, _fadeOutTime, 0, true) { }
-    void start() override {
-        if (millis() - max(_started, _held) > _fadeOutTime*4 && millis() - _lastPaletteSwap > _paletteSwapTime) {
-            _lastPaletteSwap = millis();
-            _curPaletteId++;
-            if (_curPaletteId >= paletteNum) 
-                _curPaletteId = 0;
+    void start(uint32_t now) override {
+        if (now - max(_started, _held) > _fadeOutTime*4 && now - _lastPaletteSwap > _paletteSwapTime) {
+            _lastPaletteSwap = now;
+            _palette.select((_palette.current() + 1) % paletteLibrary.count(), now, PALETTE_FADE_TIME);
         }
-        Effect::start();
+        Effect::start(now);
         _startedLight[_oddEven] = _started;
-        // _curPaletteId = (millis() / _paletteSwapTime) % paletteNum;
+        // _palette.select((now / _paletteSwapTime) % palettesNum, now, 0);
     }
-    void hold() override {
-        Effect::hold();
+    void hold(uint32_t now) override {
+        Effect::hold(now);
         _startedLight[_oddEven] = _held;
     }
     // don't stop when button is released
     void stop() override { 
         _oddEven = !_oddEven;   // switch between odd/even 
     } 
-    CRGB render(int idx) override {
-        Effect::render(idx);
-
-        int lightId = idx % _numLights;
-
-        uint32_t runtime = millis() - _startedLight[lightId];
-        uint8_t bright = 0;
-        if (runtime < _holdTime) {
-            bright = 255;
-        }
-        else if (runtime < _fadeOutTime + _holdTime) {
-            bright = 255 - ((runtime-_holdTime) * 255 / _fadeOutTime);
+    void renderFrame(CRGB *out, size_t n, uint32_t now) override {
+        calcAlpha(now);
+        _palette.update(now);
+
+        CRGB colors[_numLights];
+        for (int lightId = 0; lightId < _numLights; lightId++) {
+            uint32_t runtime = now - _startedLight[lightId];
+            uint8_t bright = 0;
+            if (runtime < _holdTime) {
+                bright = 255;
+            }
+            else if (runtime < _fadeOutTime + _holdTime) {
+                bright = 255 - ((runtime-_holdTime) * 255 / _fadeOutTime);
+            }
+            colors[lightId] = _palette.color(lightId * 255 / (_numLights - 1)).scale8(bright);
         }
 
-        // if (idx == _numPixels - 1) {
-        //     // check both timeouts, and set myself to disabled. Edit: nope, doesn't work as expected
-        //     if (millis() - _startedLight[0] > _fadeOutTime && millis() - _startedLight[1] > _fadeOutTime) {
-        //         _started = 0;
-        //     }
+        // // check both timeouts, and set myself to disabled. Edit: nope, doesn't work as expected
+        // if (now - _startedLight[0] > _fadeOutTime && now - _startedLight[1] > _fadeOutTime) {
+        //     _started = 0;
         // }
 
-        return palette[_curPaletteId][lightId].scale8(bright);
+        for (size_t i = 0; i < n; i++) {
+            out[i] = colors[i % _numLights];
+        }
     }
     
     static const int _numLights = 2;
@@ -169,89 +191,141 @@ class FXOddEven : public Effect {
     static const int _holdTime = 50;
     static const int _paletteSwapTime = 5000;
     bool _oddEven = true;
-    uint32_t _startedLight[_numLights];
-    int _curPaletteId = 0;
+    uint32_t _startedLight[_numLights] = {};
+    PaletteFader _palette;
     uint32_t _lastPaletteSwap = 0;
 };
 
-// button / effect association is done via order of this array
-Effect *effects[] = {
-    new FXStrobe(),
-    new FXOddEven(),
-    new FXRainbowFlash(),
+// the gradient of a palette moving along the pixels, every press crossfades to the next palette
+class FXPaletteWave : public Effect {
+    public:
+    FXPaletteWave() : Effect(150, 100, 800, true) { }
+    void start(uint32_t now) override {
+        _palette.select((_palette.current() + 1) % paletteLibrary.count(), now, PALETTE_FADE_TIME);
+        Effect::start(now);
+    }
+    void stop() override {} // fade out after the last hold
+    void renderFrame(CRGB *out, size_t n, uint32_t now) override {
+        calcAlpha(now);
+        _palette.update(now);
+
+        // there and back along the gradient over all pixels, so it wraps without a seam
+        uint16_t phase = ((uint64_t)(now % _period) << 16) / _period;
+        uint16_t step = n ? 65536 / n : 0;
+        for (size_t i = 0; i < n; i++) {
+            uint8_t pos = (uint16_t)(phase + i * step) >> 8;
+            out[i] = _palette.color(pos < 128 ? pos * 2 : (255 - pos) * 2);
+        }
+    }
+
+    static const uint32_t _period = 4000;    // ms, one pass of the wave
+    PaletteFader _palette;
 };
-constexpr int effectsNum = sizeof(effects) / sizeof(effects[0]);
+
+// all effects in static storage, button / effect association is done via order of this tuple
+static inline std::tuple<
+    FXStrobe,
+    FXOddEven,
+    FXRainbowFlash,
+    FXPaletteWave
+> effectStore;
+static inline auto effects = std::apply([](auto &...e) { return std::array<Effect *, sizeof...(e)>{ &e... }; }, effectStore);
+constexpr int effectsNum = std::tuple_size_v<decltype(effectStore)>;
 
 
 class EffectEngine {
     public:
-    void loop() {
-        uint32_t now = millis();
-
-        for (int i = 0; i < _numPixels; i++) {
-            uint32_t pixelOffset = i * (RAINBOW_PERIOD / _numPixels);
-            bgColorHSV.hue = ((now + animOffset + pixelOffset) % RAINBOW_PERIOD) * 255 / RAINBOW_PERIOD;
-            hsv2rgb_rainbow(bgColorHSV, bgColorRGB);
-            bgColorRGB = bgColorRGB.scale8(BASE_BRIGHTNESS);
-
-            for (int e = 0; e < effectsNum; e++) {
-                if (effects[e]->running()) {
-                    bgColorRGB = effects[e]->render(i);
-                    bgColorRGB = bgColorRGB.scale8(effects[e]->alpha());
-                    _lastEffectRun = millis();
-                    break;  // for now, don't do blending. First come, first serve
-                }
-                else if (e == effectsNum - 1) {
-                    // no effect active
-                    uint8_t idleBright = 0;
-                    if (millis() - _lastEffectRun > AFTER_EFFECT_PAUSE) {
-                        idleBright = 255;
-                        if (millis() - _lastEffectRun < AFTER_EFFECT_PAUSE + AFTER_EFFECT_FADE_UP) {
-                            uint32_t ms = millis() - (_lastEffectRun + AFTER_EFFECT_PAUSE);
-                            idleBright = ms * 255 / AFTER_EFFECT_FADE_UP;
-                        }
-                    }
-                    bgColorRGB = bgColorRGB.scale8(idleBright);
-                }
+    void loop() { loop(millis()); }
+
+    // renders one frame, all effects see the same timestamp
+    void loop(uint32_t now) {
+        rainbow.update(now + animOffset);
+
+        // render every running effect into its own layer
+        _effectRunning = false;
+        for (int e = 0; e < effectsNum; e++) {
+            if (effects[e]->running()) {
+                _effectRunning = true;
+                effects[e]->renderFrame(_layers[e + 1], _numPixels, now);
             }
+        }
+
+        uint16_t idleBright = 0;
+        if (_effectRunning) {
+            _lastEffectRun = now;
+        }
+        else if (now - _lastEffectRun > AFTER_EFFECT_PAUSE) {
+            idleBright = ALPHA16_MAX;
+            if (now - _lastEffectRun < AFTER_EFFECT_PAUSE + AFTER_EFFECT_FADE_UP) {
+                uint32_t ms = now - (_lastEffectRun + AFTER_EFFECT_PAUSE);
+                idleBright = ms * ALPHA16_MAX / AFTER_EFFECT_FADE_UP;
+            }
+        }
 
-            setPixel(i, bgColorRGB);
+        // background layer, faded in after effects stopped. The background brightness goes
+        // into the layer alpha, not the colours, so the fade keeps 16 bit resolution
+        memset(_frame, 0, _numPixels * sizeof(RGB16));
+        if (idleBright) {
+            CRGB *layer = _layers[0];
+            for (int i = 0; i < _numPixels; i++) {
+                layer[i] = rainbow.color(i);
+            }
+            blendLayer(_frame, layer, _numPixels, (uint32_t)idleBright * BASE_BRIGHTNESS / 255, BLEND_ALPHA);
+        }
+
+        // effect layers on top, in order of the effects array. Only layers rendered this
+        // frame, a layer of a stopped effect is stale
+        for (int e = 0; e < effectsNum; e++) {
+            if (effects[e]->running() && effects[e]->alpha()) {
+                blendLayer(_frame, _layers[e + 1], _numPixels, effects[e]->alpha(), effects[e]->blendMode());
+            }
         }
     }
 
-    void trigger(int triggerId, int eventType = BTN_PRESSED) {
+    void trigger(int triggerId, int eventType = BTN_PRESSED) { trigger(triggerId, eventType, millis()); }
+
+    // now: the clock given to loop()
+    void trigger(int triggerId, int eventType, uint32_t now) {
         if (triggerId < effectsNum) {
             switch (eventType) {
-                case BTN_PRESSED:   effects[triggerId]->start();    break;
-                case BTN_HOLD:      effects[triggerId]->hold();     break;
+                case BTN_PRESSED:   effects[triggerId]->start(now); break;
+                case BTN_HOLD:      effects[triggerId]->hold(now);  break;
                 case BTN_RELEASED:  effects[triggerId]->stop();     break;
             }
         } 
     }
 
-    void init(uint8_t **rgbDsts, uint8_t numPixels) {
-        _rgbDestination = rgbDsts;
-        _numPixels = numPixels;
+    // background at full brightness right away, without the pause and fade-up (after boot)
+    void skipIdleFade(uint32_t now) { _lastEffectRun = now - AFTER_EFFECT_PAUSE - AFTER_EFFECT_FADE_UP; }
+
+    // composited output of the last loop(), 16 bit per channel
+    const RGB16 *frame() const { return _frame; }
+    uint16_t numPixels() const { return _numPixels; }
+    bool effectRunning() const { return _effectRunning; }     // any button effect in the last frame, not just the background
+
+    // returns false if numPixels exceeds FX_MAX_PIXELS, the engine then runs with FX_MAX_PIXELS
+    bool init(uint16_t numPixels) {
+        _numPixels = min(numPixels, (uint16_t)FX_MAX_PIXELS);
+        rainbow.init(_numPixels, RAINBOW_PERIOD);
+        paletteLibrary.init(palettes, palettesNum);
+        memset(_frame, 0, sizeof(_frame));
+        memset(_layers, 0, sizeof(_layers));
+
         for (auto e : effects) {
             e->init(_numPixels);
         }
-    }
-
-    void setPixel(int idx, CRGB color) {
-        if (_rgbDestination && _rgbDestination[idx]) {
-            memcpy(_rgbDestination[idx], bgColorRGB.raw, 3);
-        }
+        return numPixels <= FX_MAX_PIXELS;
     }
 
     protected:
-    // background color fade
-    CHSV bgColorHSV = CHSV(0, 240, 255);    // sat=240 taken from FastLED fill_rainbow, idk
-    CRGB bgColorRGB;
     int animOffset = 0; // in ms
     uint32_t _lastEffectRun = 0;
+    bool _effectRunning = false;
+
+    uint16_t _numPixels = 0;                // number of pixels to consider in animations
 
-    uint8_t **_rgbDestination = nullptr;    // memory location where to write new colors
-    uint8_t _numPixels = 0;                 // number of pixels to consider in animations (max: 4)
+    RGB16 _frame[FX_MAX_PIXELS];                    // composited output
+    CRGB _layers[effectsNum + 1][FX_MAX_PIXELS];    // [0] = background, then one per effect
 };
 
 static inline EffectEngine fx;
\ No newline at end of file
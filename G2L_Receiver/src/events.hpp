@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+#include "common.h"
+#include "ringbuffer.hpp"
+
+// button event as handed from the receive callback to the render loop
+struct ButtonEvent {
+    uint32_t time;      // ms, receive time
+    uint8_t mac[6];     // sender
+    uint8_t buttonId;   // resolved from the MAC by the render loop
+    uint8_t btnState;   // BtnState
+    uint8_t version;    // 1 or G2L_PROTOCOL_V2, seq and pressCount only valid for v2
+    uint16_t seq;
+    uint16_t pressCount;
+    uint32_t rxUs;      // micros() in the receive callback, for latency tracing
+    uint16_t txDelay;   // us, v3 only, button side latency
+    uint16_t batVolt;   // raw payload value, mV / G2L_BAT_VOLT_FACTOR
+    int8_t rssi;        // dBm, set by the receive callback
+};
+
+static const int BUTTON_EVENT_QUEUE_SIZE = 64;
+typedef SpscRing<ButtonEvent, BUTTON_EVENT_QUEUE_SIZE> ButtonEventQueue;
+
+// fills the packet fields of ev from a button packet (v1 to v3, later versions may append
+// fields). Returns false for anything else
+inline bool decodeButtonPacket(const uint8_t *data, int len, ButtonEvent &ev) {
+    payload_v3_t p = {};
+    if (len < (int)sizeof(payload_t)) return false;
+    memcpy(&p, data, std::min(len, (int)sizeof(p)));
+    bool v2 = len >= (int)sizeof(payload_v2_t) && p.version >= G2L_PROTOCOL_V2;
+    bool v3 = len >= (int)sizeof(payload_v3_t) && p.version >= G2L_PROTOCOL_V3;
+    if ((len != sizeof(payload_t) && !v2) || p.preamble != G2L_PREAMBLE) return false;
+
+    ev.btnState = p.btnState;
+    ev.version = v3 ? G2L_PROTOCOL_V3 : v2 ? G2L_PROTOCOL_V2 : 1;
+    ev.seq = v2 ? p.seq : 0;
+    ev.pressCount = v2 ? p.pressCount : 0;
+    ev.txDelay = v3 ? p.txDelay : 0;
+    ev.batVolt = p.batVolt;
+    return true;
+}
+
+// receive callback side of the packet path: decodes a packet from srcMac into ev, which
+// already holds the receive fields (time, rxUs, rssi), and queues it for the render loop.
+// Returns false if it isn't a button packet
+inline bool queueButtonPacket(ButtonEventQueue &queue, const uint8_t *srcMac, const uint8_t *data, int len, ButtonEvent &ev) {
+    if (!decodeButtonPacket(data, len, ev)) return false;
+    memcpy(ev.mac, srcMac, 6);
+    queue.push(ev);
+    return true;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <FastLED.h>
+
+// DMX fixture profiles and patch. A profile describes the channel layout of a fixture
+// type, the patch places fixtures in the universe and assigns each one a pixel of the
+// effect engine. At init the patch gets compiled into a flat list of the colour
+// channels, static channels are written into the frame once.
+
+static const int DMX_UNIVERSE_SIZE = 513;   // start code + 512 channels
+static const int DMX_MAX_PIXELS = 512;      // one pixel per channel, e.g. dimmer-only fixtures
+static const int PROFILE_MAX_CHANNELS = 16;
+
+enum ChannelType : uint8_t {
+    CH_STATIC,      // fixed value from the profile
+    CH_RED,
+    CH_GREEN,
+    CH_BLUE,
+    CH_WHITE,       // common part of r, g and b
+    CH_DIMMER,      // brightest of r, g and b, for single colour / dimmer-only fixtures
+};
+
+struct ProfileChannel {
+    ChannelType type;
+    uint8_t value;  // CH_STATIC only
+};
+
+struct FixtureProfile {
+    const char *name;
+    uint8_t numChannels;
+    ProfileChannel channels[PROFILE_MAX_CHANNELS];
+};
+
+static const FixtureProfile PROFILE_RGB = { "RGB", 3, {
+    { CH_RED }, { CH_GREEN }, { CH_BLUE },
+} };
+static const FixtureProfile PROFILE_RGBW = { "RGBW", 4, {
+    { CH_RED }, { CH_GREEN }, { CH_BLUE }, { CH_WHITE },
+} };
+static const FixtureProfile PROFILE_RGBWAU = { "RGBWAU", 6, {
+    { CH_RED }, { CH_GREEN }, { CH_BLUE }, { CH_WHITE }, { CH_STATIC, 0 }, { CH_STATIC, 0 },
+} };
+static const FixtureProfile PROFILE_DIMMER = { "Dimmer", 1, {
+    { CH_DIMMER },
+} };
+// master, RGB, white, amber, UV, strobe, macro, macro speed
+static const FixtureProfile PROFILE_VEGA_ARC_II = { "Vega Arc II", 10, {
+    { CH_STATIC, 255 }, { CH_RED }, { CH_GREEN }, { CH_BLUE }, { CH_STATIC, 0 },
+    { CH_STATIC, 0 }, { CH_STATIC, 0 }, { CH_STATIC, 0 }, { CH_STATIC, 0 }, { CH_STATIC, 0 },
+} };
+
+struct PatchEntry {
+    uint16_t address;   // DMX start address, 1..512
+    uint16_t pixel;     // effect engine pixel driving this fixture
+    const FixtureProfile *profile;
+};
+
+class DmxPatch {
+    public:
+    // checks the patch and prepares frame (DMX_UNIVERSE_SIZE bytes). Returns false on
+    // overlapping or out of range fixtures
+    bool init(const PatchEntry *patch, size_t patchNum, uint8_t *frame) {
+        memset(frame, 0, DMX_UNIVERSE_SIZE);
+        memset(_used, 0, sizeof(_used));
+        _numOps = 0;
+        _size = 1;
+        _numPixels = 0;
+
+        for (size_t f = 0; f < patchNum; f++) {
+            const PatchEntry &entry = patch[f];
+            const FixtureProfile &profile = *entry.profile;
+            if (entry.address < 1 || entry.address + profile.numChannels - 1 > DMX_UNIVERSE_SIZE - 1 || entry.pixel >= DMX_MAX_PIXELS) {
+                return false;
+            }
+            for (int c = 0; c < profile.numChannels; c++) {
+                uint16_t slot = entry.address + c;
+                if (_used[slot]) return false;
+                _used[slot] = true;
+
+                if (profile.channels[c].type == CH_STATIC) {
+                    frame[slot] = profile.channels[c].value;
+                }
+                else {
+                    _ops[_numOps++] = { slot, entry.pixel, profile.channels[c].type };
+                }
+            }
+            if (entry.address + profile.numChannels > _size) _size = entry.address + profile.numChannels;
+            if (entry.pixel + 1 > _numPixels) _numPixels = entry.pixel + 1;
+        }
+        return true;
+    }
+
+    // writes the colour channels of all fixtures, single pass over the patched channels
+    void render(const CRGB *pixels, uint8_t *frame) const {
+        for (int i = 0; i < _numOps; i++) {
+            const Op &op = _ops[i];
+            const CRGB &px = pixels[op.pixel];
+            uint8_t value;
+            switch (op.type) {
+                case CH_RED:    value = px.r; break;
+                case CH_GREEN:  value = px.g; break;
+                case CH_BLUE:   value = px.b; break;
+                case CH_WHITE:  value = std::min(px.r, std::min(px.g, px.b)); break;
+                case CH_DIMMER: value = std::max(px.r, std::max(px.g, px.b)); break;
+                default:        continue;
+            }
+            frame[op.slot] = value;
+        }
+    }
+
+    uint16_t size() const { return _size; }             // bytes to send, start code up to the last patched channel
+    uint16_t numPixels() const { return _numPixels; }
+
+    protected:
+    struct Op {
+        uint16_t slot;
+        uint16_t pixel;
+        ChannelType type;
+    };
+    Op _ops[DMX_UNIVERSE_SIZE - 1];
+    bool _used[DMX_UNIVERSE_SIZE];
+    uint16_t _numOps = 0;
+    uint16_t _size = 1;
+    uint16_t _numPixels = 0;
+};
+
+// the rig, fixtures driven by this receiver
+static const PatchEntry fixturePatch[] = {
+    { 1,  0, &PROFILE_VEGA_ARC_II },
+    { 11, 1, &PROFILE_VEGA_ARC_II },
+};
+static const int fixturePatchNum = sizeof(fixturePatch) / sizeof(fixturePatch[0]);
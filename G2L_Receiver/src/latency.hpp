@@ -0,0 +1,150 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+// Press to light latency tracing. A press is followed through the receiver stages
+// (ESP-NOW callback, effect trigger, first rendered frame, LED and DMX output); the button
+// reports its own part (edge to handing the packet to the radio) in the v3 payload. The
+// air time in between isn't measured, it is well below a millisecond for one packet.
+// Totals go into a histogram per button for min/avg/p99/max.
+
+static const int LATENCY_BUTTONS = 32;         // buttons with their own histogram, ids above aren't traced
+static const int LATENCY_BUCKET_US = 250;
+static const int LATENCY_BUCKETS = 128;        // 32ms, the last bucket takes everything above
+static const int LATENCY_PENDING = 8;          // presses in flight between trigger and output
+static const uint32_t LATENCY_EXPIRE_US = 1000000;  // presses that never changed the output
+
+enum LatencyStage : uint8_t {
+    STAGE_BUTTON,       // button edge -> radio
+    STAGE_QUEUE,        // receive callback -> effect trigger (waiting for the frame)
+    STAGE_RENDER,       // trigger -> frame rendered
+    STAGE_OUTPUT,       // rendered -> DMX frame handed to the driver
+    STAGE_NUM,
+};
+
+class LatencyTracer {
+    public:
+    struct ButtonStats {
+        uint32_t count = 0;
+        uint32_t minUs = UINT32_MAX;
+        uint32_t maxUs = 0;
+        uint64_t sumUs = 0;
+        uint64_t stageSumUs[STAGE_NUM] = {};
+        uint32_t ledSumUs = 0;      // rendered -> LED strip shown, ledCount samples
+        uint32_t ledCount = 0;
+        uint32_t expired = 0;
+        uint16_t histogram[LATENCY_BUCKETS] = {};
+
+        uint32_t avgUs() const { return count ? sumUs / count : 0; }
+        uint32_t stageAvgUs(int stage) const { return count ? stageSumUs[stage] / count : 0; }
+
+        // upper bound of the bucket holding the given percentile
+        uint32_t percentileUs(int percent) const {
+            uint32_t target = ((uint64_t)count * percent + 99) / 100, seen = 0;
+            for (int i = 0; i < LATENCY_BUCKETS; i++) {
+                seen += histogram[i];
+                if (seen >= target) return (i + 1) * LATENCY_BUCKET_US;
+            }
+            return maxUs;
+        }
+    };
+
+    // effect triggered by a press. rxUs: micros() in the receive callback, buttonUs: the
+    // button's own part (0 if the button doesn't report it)
+    void triggered(int buttonId, uint32_t rxUs, uint32_t buttonUs, uint32_t nowUs) {
+        if (buttonId >= LATENCY_BUTTONS) return;
+        Trace *t = nullptr;
+        for (Trace &p : _pending) {
+            if (p.buttonId < 0) { t = &p; break; }
+        }
+        if (!t) return;     // more presses in one frame than slots, skip this one
+        *t = { .buttonId = (int16_t)buttonId, .buttonUs = buttonUs, .rxUs = rxUs, .triggerUs = nowUs };
+        _numPending++;
+    }
+
+    // call after each frame was rendered, with the output that actually happened
+    void rendered(uint32_t nowUs) {
+        if (!_numPending) return;
+        for (Trace &t : _pending) {
+            if (t.buttonId >= 0 && !t.renderedUs) t.renderedUs = nowUs ? nowUs : 1;
+        }
+    }
+
+    // output of the frame rendered at frameUs (the value given to rendered()). With the
+    // pipelined output this arrives while later frames are already rendered
+    void ledShown(uint32_t nowUs, uint32_t frameUs) {
+        if (!_numPending) return;
+        for (Trace &t : _pending) {
+            if (inFrame(t, frameUs) && !t.ledUs) t.ledUs = nowUs ? nowUs : 1;
+        }
+    }
+
+    // the DMX frame went out. Presses whose frame didn't change anything stay pending
+    // until the output changes or they expire
+    void dmxSent(uint32_t nowUs, uint32_t frameUs) {
+        if (!_numPending) return;
+        for (Trace &t : _pending) {
+            if (inFrame(t, frameUs)) finish(t, nowUs);
+        }
+    }
+
+    void expire(uint32_t nowUs) {
+        if (!_numPending) return;
+        for (Trace &t : _pending) {
+            if (t.buttonId >= 0 && nowUs - t.triggerUs > LATENCY_EXPIRE_US) {
+                _stats[t.buttonId].expired++;
+                t.buttonId = -1;
+                _numPending--;
+            }
+        }
+    }
+
+    const ButtonStats &stats(int buttonId) const { return _stats[buttonId]; }
+    void reset() {
+        for (ButtonStats &st : _stats) st = ButtonStats();
+    }
+
+    protected:
+    struct Trace {
+        int16_t buttonId = -1;
+        uint32_t buttonUs;
+        uint32_t rxUs;
+        uint32_t triggerUs;
+        uint32_t renderedUs = 0;
+        uint32_t ledUs = 0;
+    };
+
+    static bool inFrame(const Trace &t, uint32_t frameUs) {
+        return t.buttonId >= 0 && t.renderedUs && (int32_t)(t.renderedUs - frameUs) <= 0;
+    }
+
+    void finish(Trace &t, uint32_t outUs) {
+        ButtonStats &st = _stats[t.buttonId];
+        uint32_t stages[STAGE_NUM] = { t.buttonUs, t.triggerUs - t.rxUs, t.renderedUs - t.triggerUs, outUs - t.renderedUs };
+        uint32_t total = 0;
+        for (int i = 0; i < STAGE_NUM; i++) {
+            st.stageSumUs[i] += stages[i];
+            total += stages[i];
+        }
+        if (t.ledUs) {
+            st.ledSumUs += t.ledUs - t.renderedUs;
+            st.ledCount++;
+        }
+
+        st.count++;
+        st.sumUs += total;
+        if (total < st.minUs) st.minUs = total;
+        if (total > st.maxUs) st.maxUs = total;
+        int bucket = total / LATENCY_BUCKET_US;
+        if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+        if (st.histogram[bucket] < UINT16_MAX) st.histogram[bucket]++;
+
+        t.buttonId = -1;
+        _numPending--;
+    }
+
+    Trace _pending[LATENCY_PENDING];
+    int _numPending = 0;
+    ButtonStats _stats[LATENCY_BUTTONS];
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <stdint.h>
+#include <string.h>
+
+// Output drivers for the LED strip. FastLED's show() blocks for the whole transfer
+// (30us per LED), the RMT driver only encodes the frame and lets the peripheral send it
+// while the output task goes on with DMX. SimLedDriver sends nowhere and keeps the
+// timing of each frame, for the host tools or a board without a strip.
+
+static const uint32_t LED_US_PER_LED = 30;     // WS2812: 24 bits at 800kHz
+static const uint32_t LED_RESET_US = 80;       // low time that latches the frame
+
+class LedDriver {
+    public:
+    struct Stats {
+        uint32_t frames = 0;
+        uint32_t waits = 0;         // frames that had to wait for the previous one
+        uint32_t showMaxUs = 0;     // time spent in show()
+    };
+
+    LedDriver(size_t numLeds) : _numLeds(numLeds) { }
+    virtual ~LedDriver() = default;
+
+    virtual bool begin() = 0;
+
+    // sends numLeds() LEDs, returns the micros() at which the strip shows the frame
+    uint32_t show(const CRGB *leds) {
+        uint32_t start = micros();
+        uint32_t doneUs = send(leds);
+        uint32_t took = micros() - start;
+        _stats.frames++;
+        if (took > _stats.showMaxUs) _stats.showMaxUs = took;
+        return doneUs;
+    }
+
+    // the last frame is still going out
+    virtual bool busy() const { return false; }
+
+    size_t numLeds() const { return _numLeds; }
+    uint32_t wireUs() const { return _numLeds * LED_US_PER_LED + LED_RESET_US; }
+    const Stats &stats() const { return _stats; }
+    void resetStats() { _stats = Stats(); }
+
+    protected:
+    virtual uint32_t send(const CRGB *leds) = 0;
+
+    size_t _numLeds;
+    Stats _stats;
+};
+
+// no strip, records when each frame would have been sent. Frames that come while the
+// last one is still on the wire count as waits, like on the RMT driver
+template <size_t N, size_t HISTORY = 64>
+class SimLedDriver : public LedDriver {
+    public:
+    struct Timing {
+        uint32_t startUs;
+        uint32_t doneUs;
+    };
+
+    SimLedDriver() : LedDriver(N) { }
+
+    bool begin() override { return true; }
+    bool busy() const override { return _sent && (int32_t)(micros() - _doneUs) < 0; }
+
+    const CRGB *frame() const { return _frame; }        // the last frame sent
+    uint32_t sent() const { return _sent; }
+    // i = 0 is the last frame, up to HISTORY - 1
+    const Timing &timing(size_t i) const { return _history[(_sent - 1 - i) % HISTORY]; }
+
+    protected:
+    uint32_t send(const CRGB *leds) override {
+        uint32_t start = micros();
+        if (busy()) {
+            _stats.waits++;
+            start = _doneUs;    // the wire is free again then
+        }
+        memcpy(_frame, leds, sizeof(_frame));
+        _doneUs = start + wireUs();
+        _history[_sent % HISTORY] = { start, _doneUs };
+        _sent++;
+        return _doneUs;
+    }
+
+    CRGB _frame[N];
+    Timing _history[HISTORY];
+    uint32_t _sent = 0;
+    uint32_t _doneUs = 0;
+};
+
+#ifdef ESP32
+
+// FastLED's own driver, blocks until the frame is out
+template <uint8_t PIN, size_t N>
+class FastLedDriver : public LedDriver {
+    public:
+    FastLedDriver() : LedDriver(N) { }
+
+    bool begin() override {
+        FastLED.addLeds<NEOPIXEL, PIN>(_leds, N);      // colour correction is done by the output converter
+        FastLED.setBrightness(255);
+        return true;
+    }
+
+    protected:
+    uint32_t send(const CRGB *leds) override {
+        memcpy(_leds, leds, sizeof(_leds));
+        FastLED.show();
+        return micros();
+    }
+
+    CRGB _leds[N];
+};
+
+// WS2812 through the RMT peripheral of the Arduino core, returns as soon as the frame is
+// encoded. The symbol buffer is in use until the transfer ends, so a frame arriving
+// earlier waits for it
+template <size_t N>
+class RmtLedDriver : public LedDriver {
+    public:
+    RmtLedDriver(int pin) : LedDriver(N), _pin(pin) { }
+
+    bool begin() override {
+        return rmtInit(_pin, RMT_TX_MODE, RMT_MEM_NUM_BLOCKS_1, RMT_TICK_HZ);
+    }
+
+    bool busy() const override { return _sending && !rmtTransmitCompleted(_pin); }
+
+    protected:
+    static const uint32_t RMT_TICK_HZ = 10000000;      // 100ns
+    // high / low ticks of a bit, WS2812 tolerates +-150ns
+    static const uint16_t T0H = 4, T0L = 8, T1H = 8, T1L = 4;
+
+    uint32_t send(const CRGB *leds) override {
+        if (busy()) {
+            _stats.waits++;
+            while (busy()) delayMicroseconds(10);
+        }
+
+        rmt_data_t *sym = _symbols;
+        for (size_t i = 0; i < N; i++) {
+            uint8_t grb[3] = { leds[i].g, leds[i].r, leds[i].b };
+            for (uint8_t byte : grb) {
+                for (int bit = 7; bit >= 0; bit--, sym++) {
+                    bool one = byte & (1 << bit);
+                    sym->level0 = 1;
+                    sym->duration0 = one ? T1H : T0H;
+                    sym->level1 = 0;
+                    sym->duration1 = one ? T1L : T0L;
+                }
+            }
+        }
+        uint32_t start = micros();
+        _sending = rmtWriteAsync(_pin, _symbols, N * 24);
+        return start + wireUs();
+    }
+
+    int _pin;
+    bool _sending = false;
+    rmt_data_t _symbols[N * 24];
+};
+
+#endif
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "common.h"
+#include "ringbuffer.hpp"
+
+// Deferred binary logging. Producers (e.g. the ESP-NOW callback) only copy a small
+// record into a preallocated ring, formatting and printing happens later from the
+// render loop in idle time, without ever blocking on the serial port.
+// There is one ring per producer task, so both stay single-producer.
+
+enum LogLevel : uint8_t {
+    LOG_NONE = 0,
+    LOG_ERROR,
+    LOG_INFO,
+    LOG_DEBUG,
+};
+
+enum LogType : uint8_t {
+    LOG_RX_PACKET,      // valid packet. data = MAC
+    LOG_RX_CHECKIN,     // check-in of an idle button. data = MAC
+    LOG_RX_UNKNOWN_MAC, // valid packet, unknown sender. data = MAC
+    LOG_RX_UNKNOWN,     // unknown payload. data = first bytes
+    LOG_BUTTON,         // button event applied to the effects
+    LOG_PAIRED,         // new button learned in pairing mode. data = MAC
+};
+
+struct LogRecord {
+    uint32_t time;      // ms
+    LogType type;
+    uint8_t buttonId;   // registry id, 0..MAX_BUTTONS-1
+    int8_t rssi;        // dBm
+    uint8_t btnState;
+    uint16_t batVolt;   // raw payload value
+    uint8_t len;        // payload length
+    uint8_t data[8];
+};
+
+static const int LOG_QUEUE_SIZE = 128;
+static const int LOG_LINE_MAX = 64;     // don't start a line if the serial TX buffer has less space left
+
+class Logger {
+    public:
+    void setLevel(LogLevel level) { _level = level; }
+    LogLevel level() const { return _level; }
+    bool enabled(LogLevel level) const { return level <= _level; }
+
+    // from the receive callback (WiFi task)
+    void logRx(LogLevel level, const LogRecord &rec) {
+        if (enabled(level)) {
+            _rxQueue.push(rec);
+        }
+    }
+
+    // from the render loop
+    void log(LogLevel level, const LogRecord &rec) {
+        if (enabled(level)) {
+            _queue.push(rec);
+        }
+    }
+
+    // print queued records until the time budget is used up or the serial buffer is full
+    void drain(uint32_t budgetUs) {
+        uint32_t start = micros();
+        LogRecord rec;
+        while (micros() - start < budgetUs && Serial.availableForWrite() >= LOG_LINE_MAX && (_queue.pop(rec) || _rxQueue.pop(rec))) {
+            print(rec);
+        }
+        if (dropped() != _reportedDropped && Serial.availableForWrite() >= LOG_LINE_MAX) {
+            _reportedDropped = dropped();
+            Serial.printf("(%8u) log: %u records dropped\n", millis(), _reportedDropped);
+        }
+    }
+
+    uint32_t dropped() const { return _queue.dropped() + _rxQueue.dropped(); }
+
+    protected:
+    void print(const LogRecord &rec) {
+        switch (rec.type) {
+            case LOG_RX_PACKET:
+                Serial.printf("(%8u) %02X:%02X:%02X:%02X:%02X:%02X %4ddBm: %d - %dmV\n", rec.time,
+                    rec.data[0], rec.data[1], rec.data[2], rec.data[3], rec.data[4], rec.data[5], rec.rssi, rec.btnState, rec.batVolt * G2L_BAT_VOLT_FACTOR);
+                break;
+            case LOG_RX_CHECKIN:
+                Serial.printf("(%8u) %02X:%02X:%02X:%02X:%02X:%02X %4ddBm: check-in - %dmV\n", rec.time,
+                    rec.data[0], rec.data[1], rec.data[2], rec.data[3], rec.data[4], rec.data[5], rec.rssi, rec.batVolt * G2L_BAT_VOLT_FACTOR);
+                break;
+            case LOG_RX_UNKNOWN_MAC:
+                Serial.printf("(%8u) %02X:%02X:%02X:%02X:%02X:%02X: unknown button\n", rec.time,
+                    rec.data[0], rec.data[1], rec.data[2], rec.data[3], rec.data[4], rec.data[5]);
+                break;
+            case LOG_PAIRED:
+                Serial.printf("(%8u) %02X:%02X:%02X:%02X:%02X:%02X: paired as B %d\n", rec.time,
+                    rec.data[0], rec.data[1], rec.data[2], rec.data[3], rec.data[4], rec.data[5], rec.buttonId);
+                break;
+            case LOG_RX_UNKNOWN:
+                Serial.printf("(%8u) %4ddBm: unknown payload (%d bytes):", rec.time, rec.rssi, rec.len);
+                for (int i = 0; i < rec.len && i < (int)sizeof(rec.data); i++) {
+                    Serial.printf(" %02X", rec.data[i]);
+                }
+                Serial.println();
+                break;
+            case LOG_BUTTON:
+                Serial.printf("(%8u) B %d: %s\n", rec.time, rec.buttonId, (rec.btnState == BTN_PRESSED) ? "Pres" : "Rel");
+                break;
+        }
+    }
+
+    SpscRing<LogRecord, LOG_QUEUE_SIZE> _rxQueue;
+    SpscRing<LogRecord, LOG_QUEUE_SIZE / 4> _queue;
+    LogLevel _level = LOG_INFO;
+    uint32_t _reportedDropped = 0;
+};
+
+static inline Logger logger;
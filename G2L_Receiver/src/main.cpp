@@ -1,18 +1,45 @@
 #include <Arduino.h>
 #include <WiFi.h>
-#include <esp_now.h>
 
 #include <esp_dmx.h>
+#include <soc/soc_caps.h>
+#include <Preferences.h>
 
 #include "common.h"
 #include "util.hpp"
 #include "effect.hpp"
+#include "scheduler.hpp"
+#include "events.hpp"
+#include "log.hpp"
+#include "buttons.hpp"
+#include "fixtures.hpp"
+#include "recorder.hpp"
+#include "netoutput.hpp"
+#include "latency.hpp"
+#include "output.hpp"
+#include "pipeline.hpp"
+#include "pixelmap.hpp"
+#include "leddriver.hpp"
+#include "showclock.hpp"
+#include "transport.hpp"
+#include "merge.hpp"
+#include "telemetry.hpp"
 
 #include <FastLED.h>
 const int NUM_LEDS = 24;
 const int DATA_PIN = 22;
 // const int DATA_PIN = 4;
-CRGB leds[NUM_LEDS];
+CRGB leds[NUM_LEDS];            // last frame sent to the strip
+
+// the strip shows the two fixture colours as a gradient, fixture 0 at both ends
+const LedSegment ledSegments[] = {
+    { .first = 0, .length = NUM_LEDS, .pixel = 0, .numPixels = 2, .mode = MAP_MIRROR },
+};
+const int ledSegmentsNum = sizeof(ledSegments) / sizeof(ledSegments[0]);
+
+RmtLedDriver<NUM_LEDS> rmtLedDriver(DATA_PIN);
+FastLedDriver<DATA_PIN, NUM_LEDS> fastLedDriver;
+LedDriver &ledDriver = rmtLedDriver;    // fastLedDriver: FastLED's show(), blocks for the whole transfer
 
 const int PIN_DMX_TX = 21;
 const int PIN_DMX_RX = 5;
@@ -21,69 +48,263 @@ const int PIN_DMX_EN = 23;
 // const int PIN_DMX_RX = 21;
 // const int PIN_DMX_EN = 17; // 19 for general enable
 
-const int RX_TIMEOUT = 200;     // ms, timeout after which button is assumed released
-const int RX_DEDUP_TIME = 15;   // ms, until next packet of same type is accepted again
+// DMX input from a lighting console, merged with the effect output per channel. The output
+// transceiver is half duplex, so this needs a second port and transceiver
+const int PIN_DMX_IN_RX = -1;           // -1: no DMX input
+const int PIN_DMX_IN_EN = -1;
+// UART 0 has the serial console and 1 the output. The C3 has no third UART, there the input
+// can only take UART 0 if the console is on USB
+#if SOC_UART_NUM > 2
+const dmx_port_t DMX_IN_PORT = 2;
+#elif ARDUINO_USB_CDC_ON_BOOT
+const dmx_port_t DMX_IN_PORT = 0;
+#else
+const dmx_port_t DMX_IN_PORT = DMX_NUM_MAX;     // none
+#endif
+static_assert(PIN_DMX_IN_RX < 0 || DMX_IN_PORT < DMX_NUM_MAX, "no UART left for DMX input on this target");
+const int DMX_IN_TASK_PRIORITY = 3;     // above the output task, it only reads a frame into a buffer
+const MergeRule mergeRules[] = {
+    { .first = 1, .last = 20, .mode = MERGE_HTP },    // both Vega Arc II: the console's look, effects on top
+};
+const int mergeRulesNum = sizeof(mergeRules) / sizeof(mergeRules[0]);
+
+const int FRAME_RATE = 100;             // Hz, strobe needs >= 50Hz. A full DMX universe would limit this to ~44Hz
+const int DMX_KEEPALIVE = 100;          // ms, resend unchanged DMX frames so fixtures don't assume signal loss
+const int LED_KEEPALIVE = 1000;         // ms, refresh unchanged LED strip occasionally (glitch recovery)
+const int FRAME_STATS_INTERVAL = 10000; // ms
+const int OUTPUT_STATS_TIMEOUT = 100;   // ms the stats line waits for the output's counters
+
+const uint32_t CONVERT_BUDGET = 1000;   // us per frame for the 16 -> 8 bit conversion of all outputs
+
+// dual core chips render the next frame while an output task on the other core sends the
+// last one (LED strip, DMX, network). Single core chips (C3) do both in the loop
+#if CONFIG_FREERTOS_UNICORE
+const bool PIPELINED_OUTPUT = false;
+#else
+const bool PIPELINED_OUTPUT = true;
+#endif
+const int OUTPUT_TASK_CORE = 0;         // the loop runs on core 1
+const int OUTPUT_TASK_PRIORITY = 2;     // above the loop
+const int RADIO_TASK_PRIORITY = 1;      // WiFi and ESP-NOW start next to the loop after boot
+
+// after a power cycle the fixtures get the last look from NVS first, which then fades into
+// the live output. It is saved periodically while no button effect runs, a save (flash
+// write) costs one late frame
+const uint32_t SCENE_SAVE_INTERVAL = 10 * 60 * 1000;   // ms
+const uint32_t SCENE_FADE_TIME = 2000;                 // ms, restored scene -> live output, a button effect cuts it short
+
+// network DMX output (Art-Net / sACN) of the same universe, in addition to the wired port.
+// The access point has to be on the same channel the buttons use for ESP-NOW
+const char *NET_SSID = nullptr;         // nullptr: network output disabled
+const char *NET_PASSWORD = "";
+const NetProtocol NET_PROTOCOL = NET_SACN;
+const char *NET_DEST = nullptr;         // nullptr: sACN multicast, Art-Net needs a (broadcast) address
+const uint16_t NET_UNIVERSE = 1;
 
 dmx_port_t dmxPort = 1;
 byte dmxData[DMX_PACKET_SIZE];
+byte effectDmx[DMX_PACKET_SIZE];    // patched effect output, before the merge with the console
+DmxPatch dmxPatch;
+DmxMerge dmxMerge;
+uint16_t dmxSendSize;               // patch and merged channels
+CRGB pixels[DMX_MAX_PIXELS];    // effect engine output reduced for DMX, mapped to fixtures by the patch
+PixelMap<NUM_LEDS> ledMap;
+RGB16 ledFrame[NUM_LEDS];       // effect engine output mapped to the strip
+OutputConverter<DMX_MAX_PIXELS> dmxOutput(dmxCurve, DMX_BALANCE, DMX_DITHER);
+OutputConverter<NUM_LEDS> ledOutput(ledCurve, LED_BALANCE, LED_DITHER);
+uint32_t convertMaxUs = 0, convertOverBudget = 0;
+
+byte bootScene[DMX_PACKET_SIZE];    // restored from NVS, later the snapshot to save
+bool sceneFading = false, sceneSaveDue = false, sceneSnapshot = false;
+uint32_t sceneFadeStart = 0, lastSceneSave = 0;
+
+// boot phases in us since boot, the bootloader's time comes before that
+enum BootPhase {
+    BOOT_SCENE,         // first DMX frame out
+    BOOT_SETUP,         // setup() done
+    BOOT_FIRST_FRAME,   // first frame of the loop
+    BOOT_RADIO,         // ESP-NOW (and WiFi) started
+    BOOT_PHASES,
+};
+const char *bootPhaseNames[BOOT_PHASES] = { "scene out", "setup", "first frame", "radio" };
+uint32_t bootUs[BOOT_PHASES];
+bool sceneRestored = false, bootReported = false;
+std::atomic<bool> radioReady{false};
+
+// everything the outputs need of one rendered frame
+struct OutputFrame {
+    CRGB leds[NUM_LEDS];
+    uint8_t dmx[DMX_PACKET_SIZE];
+    uint32_t renderedUs;
+    uint32_t ledShownUs, dmxSentUs;     // set by the output, 0 if it was unchanged (keepalives too)
+};
+FramePipeline<OutputFrame> pipeline;
+TaskHandle_t outputTask = nullptr;
+uint32_t outputBusy = 0;                // frames not rendered because both buffers were still out
+uint32_t outputMaxUs = 0;
+void outputLoop(void *);
+
+// the output's counters are only written and reset by whoever runs pushOutputs(). For the
+// stats line the loop asks for them (STATS_WANTED), the output copies them into outputStats
+// and resets them before its next frame (STATS_READY), the loop prints and hands back
+struct OutputStats {
+    uint32_t maxUs;
+    uint32_t ledPushed, ledSkipped, dmxPushed, dmxSkipped;
+    LedDriver::Stats led;
+    bool netStarted;
+    NetOutput::Stats net;
+};
+enum OutputStatsState : uint8_t {
+    STATS_IDLE,
+    STATS_WANTED,
+    STATS_TAKING,       // the output is writing outputStats
+    STATS_READY,        // the loop may read outputStats
+};
+OutputStats outputStats;
+std::atomic<uint8_t> outputStatsState{STATS_IDLE};
+bool frameStatsDue = false;
+
+// console universe, received by its own task at the console's rate. The render loop merges
+// the newest one straight from the buffer
+struct DmxInputFrame {
+    uint8_t data[DMX_PACKET_SIZE];
+    uint32_t receivedMs;
+};
+TripleBuffer<DmxInputFrame> dmxInput;
+std::atomic<uint32_t> dmxInFrames{0}, dmxInErrors{0};   // counted by the input task
+void dmxInputLoop(void *);
 
 // uint8_t *buttonMacAddr[] = {
 //     STR2MAC("FF:FF:FF:FF:FF:FF"),
 //     STR2MAC("12:34:56:78:9A:BC"),
 // };
 
+// known buttons when nothing is stored yet, more can be learned in pairing mode. The id is
+// the position here, it picks the effect at the same position in effectStore
 constexpr auto buttonMacAddr = std::to_array({
-    str2mac("3C:84:27:AD:E3:68"), // Spare (now strobe)
-    str2mac("3C:84:27:AD:F1:0C"), // OddEven
-    str2mac("E8:06:90:66:85:1C"), // Blink
-    str2mac("3C:84:27:AD:7D:08"), // Strobe
+    str2mac("3C:84:27:AD:E3:68"), // FXStrobe
+    str2mac("3C:84:27:AD:F1:0C"), // FXOddEven
+    str2mac("E8:06:90:66:85:1C"), // FXRainbowFlash
+    str2mac("3C:84:27:AD:7D:08"), // FXPaletteWave
 });
-constexpr int buttonNum = buttonMacAddr.size();
-
-uint32_t buttonLastReceived[buttonNum] = {0};
-int buttonLastState[buttonNum] = {0};
-
-typedef struct {
-    uint8_t master;
-    uint8_t red;
-    uint8_t green;
-    uint8_t blue;
-    uint8_t white;
-    uint8_t amber;
-    uint8_t uv;
-    uint8_t strobe;
-    uint8_t macro;
-    uint8_t macroSpeed;
-} fixture_vega_arc_ii_t;
-
-const int fixturesNum = 2;
-#pragma pack(push, 1)
-typedef struct {
-    uint8_t startByte;
-    fixture_vega_arc_ii_t fixtures[fixturesNum];
-    // uint8_t padding[492];
-} dmxData_t;
-dmxData_t dmxPayload = {0};
-#pragma pack(pop)
-
-
-// Function to find the index of a MAC address in the array
-int findMacIndex(const uint8_t* macAddr) {
-    auto it = std::find(buttonMacAddr.begin(), buttonMacAddr.end(), std::array<uint8_t, 6>{macAddr[0], macAddr[1], macAddr[2], macAddr[3], macAddr[4], macAddr[5]});
-    
-    if (it != buttonMacAddr.end()) {
-        return std::distance(buttonMacAddr.begin(), it);
+
+EspNowTransport espNow;
+Transport &transport = espNow;
+ButtonEventQueue buttonEvents;    // from the receive callback to the render loop
+EventRecorder<1024> recorder;      // "rec start", about 45 s of a busy session (12 KB)
+ButtonRegistry buttonRegistry;
+Preferences prefs;
+bool pairing = false;
+
+// several receivers keep their effects in phase through a show clock, one of them (set with
+// "sync master", kept in NVS) broadcasts beacons to the others
+ShowClock showClock;
+SyncRole syncRole = SYNC_FOLLOWER;
+struct BeaconRx {
+    uint64_t showUs;
+    uint64_t localUs;
+    uint8_t seq;
+};
+SpscRing<BeaconRx, 4> beaconRx;   // from the receive callback to the render loop
+uint8_t beaconSeq = 0;
+uint32_t lastBeacon = 0;
+
+// effects and the frame grid run on the show clock, everything else on the local clock
+uint64_t showUs() { return showClock.now(esp_timer_get_time()); }
+uint32_t showMillis() { return showUs() / 1000; }
+
+// paired buttons are kept in NVS, in id order
+void loadButtons() {
+    buttonRegistry.clear();
+    uint8_t macs[MAX_BUTTONS * 6];
+    size_t len = prefs.getBytes("buttons", macs, sizeof(macs));
+    if (len == 0 || len % 6) {
+        for (auto &mac : buttonMacAddr) {
+            buttonRegistry.add(mac.data());
+        }
+        return;
+    }
+    for (size_t i = 0; i < len; i += 6) {
+        buttonRegistry.add(macs + i);
     }
-    return -1; // Not found
 }
 
+void saveButtons() {
+    prefs.putBytes("buttons", buttonRegistry.macs(), buttonRegistry.count() * 6);
+}
+
+
+LatencyTracer latency;
+LinkTelemetry telemetry;
+uint8_t linkWarnings[TELEMETRY_BUTTONS];        // reported so far, warnings are printed once
+
+// from the transport, on the WiFi task for ESP-NOW
+void packetRx(const uint8_t *srcMac, const uint8_t *data, int data_len, int8_t rssi) {
+    uint64_t rxLocalUs = esp_timer_get_time();     // first, beacons need a precise arrival time
+    if (data_len == sizeof(beacon_t) && ((const beacon_t *)data)->preamble == G2L_BEACON_PREAMBLE) {
+        const beacon_t *beacon = (const beacon_t *)data;
+        beaconRx.push({ .showUs = beacon->showUs, .localUs = rxLocalUs, .seq = beacon->seq });
+        return;
+    }
+
+    uint32_t now = millis();
+    LogRecord rec = { .time = now, .type = LOG_RX_UNKNOWN, .buttonId = 0, .rssi = rssi, .len = (uint8_t)data_len };
+
+    // the sender gets resolved to a button by the render loop
+    ButtonEvent ev = { .time = now, .buttonId = 0, .rxUs = micros(), .rssi = rssi };
+    if (queueButtonPacket(buttonEvents, srcMac, data, data_len, ev)) {
+        rec.type = ev.btnState == BTN_CHECKIN ? LOG_RX_CHECKIN : LOG_RX_PACKET;
+        rec.btnState = ev.btnState;
+        rec.batVolt = ev.batVolt;
+        memcpy(rec.data, srcMac, 6);
+        logger.logRx(ev.btnState == BTN_CHECKIN ? LOG_INFO : LOG_DEBUG, rec);
+    }
+    else {
+        memcpy(rec.data, data, min(data_len, (int)sizeof(rec.data)));
+        logger.logRx(LOG_DEBUG, rec);
+    }
+}
+
+// render loop side of the packet path (ButtonEventDispatcher): unknown senders are paired
+// while pairing is on, known ones feed the telemetry and the recorder
+int unknownButton(const ButtonEvent &ev) {
+    if (pairing && ev.btnState == BTN_PRESSED) {
+        int buttonId = buttonRegistry.add(ev.mac);
+        if (buttonId >= 0) {
+            saveButtons();
+            LogRecord rec = { .time = ev.time, .type = LOG_PAIRED, .buttonId = (uint8_t)buttonId };
+            memcpy(rec.data, ev.mac, 6);
+            logger.log(LOG_ERROR, rec);     // always interesting
+            return buttonId;
+        }
+    }
+    LogRecord rec = { .time = ev.time, .type = LOG_RX_UNKNOWN_MAC };
+    memcpy(rec.data, ev.mac, 6);
+    logger.log(LOG_INFO, rec);
+    return -1;
+}
+
+bool knownButton(const ButtonEvent &ev) {
+    telemetry.add(ev.buttonId, ev);
+    if (ev.btnState == BTN_CHECKIN) return false;     // battery report only
+    recorder.record(ev);
+    return true;
+}
+
+void handleButtonEvent(int buttonId, int buttonState);
+ButtonTracker buttons(handleButtonEvent);
+ButtonEventDispatcher buttonDispatch(buttonEvents, buttonRegistry, buttons, unknownButton, knownButton);
 
 void handleButtonEvent(int buttonId, int buttonState) {
     if (buttonState == BTN_PRESSED || buttonState == BTN_RELEASED) {
-        Serial.printf("B %d: %s\n", buttonId, (buttonState == BTN_PRESSED) ? "Pres" : "Rel");
+        logger.log(LOG_INFO, { .time = millis(), .type = LOG_BUTTON, .buttonId = (uint8_t)buttonId, .btnState = (uint8_t)buttonState });
     }
 
-    fx.trigger(buttonId, buttonState);
+    fx.trigger(buttonId, buttonState, showMillis());
+    const ButtonEvent *ev = buttonDispatch.current();
+    if (buttonState == BTN_PRESSED && ev) {
+        latency.triggered(buttonId, ev->rxUs, ev->txDelay, micros());
+    }
 
     
     // Debug
@@ -95,131 +316,597 @@ void handleButtonEvent(int buttonId, int buttonState) {
     }
 }
 
-void espNowRx(const esp_now_recv_info_t * esp_now_info, const uint8_t *data, int data_len) {
-    uint8_t * src_mac = esp_now_info->src_addr;
-    payload_t *payload = (payload_t*)data;
+// follower: discipline the show clock to the master's beacons. Master: send them
+void updateSync() {
+    BeaconRx rx;
+    while (beaconRx.pop(rx)) {
+        if (syncRole == SYNC_FOLLOWER) {
+            showClock.beacon(rx.showUs, rx.seq, rx.localUs);
+        }
+    }
+    if (syncRole == SYNC_MASTER && radioReady && millis() - lastBeacon >= SYNC_BEACON_INTERVAL) {
+        lastBeacon = millis();
+        beacon_t beacon = { .preamble = G2L_BEACON_PREAMBLE, .seq = ++beaconSeq, .showUs = showUs() };
+        transport.send(TRANSPORT_BROADCAST, (const uint8_t *)&beacon, sizeof(beacon));
+    }
+}
 
-    Serial.printf("(%8d) %s %4ddBm", 
-        millis(), 
-        mac2str(src_mac), 
-        esp_now_info->rx_ctrl->rssi);
+void setSyncRole(SyncRole role) {
+    syncRole = role;
+    if (role == SYNC_MASTER) {
+        showClock.setMaster(esp_timer_get_time());
+    }
+    showClock.resetStats();
+}
 
-    if (data_len == sizeof(payload_t) && payload->preamble == G2L_PREAMBLE) {
-        // TODO: trigger effect based on sender MAC
-        int buttonId = findMacIndex(src_mac);
-        Serial.printf(" (%d):", buttonId);
-        if (buttonId == -1) return;
+void printBoot() {
+    Serial.printf("Boot (%s):", sceneRestored ? "scene restored" : "no scene stored");
+    for (int i = 0; i < BOOT_PHASES; i++) {
+        if (bootUs[i]) Serial.printf(" %s %u.%ums", bootPhaseNames[i], bootUs[i] / 1000, bootUs[i] / 100 % 10);
+    }
+    Serial.println();
+}
 
-        Serial.printf(" %d - %dmV", payload->btnState, payload->batVolt * 4);    //*4? shouldn't it be *2?
+// the fixtures get the last scene from NVS before anything slow happens. A scene saved
+// with another patch (different size) is ignored, the frame then only has the static channels
+void startDmx() {
+    if (!dmxPatch.init(fixturePatch, fixturePatchNum, effectDmx)) {
+        Serial.println("ERROR: Fixture patch overlaps or exceeds the universe");
+    }
+    if (!dmxMerge.init(mergeRules, mergeRulesNum)) {
+        Serial.println("ERROR: DMX merge rules overlap or exceed the universe");
+    }
+    dmxSendSize = PIN_DMX_IN_RX >= 0 ? max(dmxPatch.size(), dmxMerge.size()) : dmxPatch.size();
 
-        // Serial.printf("State: %d (%d), Time: %d (%d)\n", payload->btnState, buttonLastState[buttonId], millis(), buttonLastReceived[buttonId]);
-        
-        // deduplicate multiple sent events (except hold events)
-        if (buttonLastState[buttonId] != payload->btnState || millis() - buttonLastReceived[buttonId] > 50 || payload->btnState == BTN_HOLD) {
-            // inject "pressed" event when first newly received event is "hold" (missed "pressed" transmission)
-            if (buttonLastState[buttonId] == BTN_RELEASED && payload->btnState == BTN_HOLD) {
-                handleButtonEvent(buttonId, BTN_PRESSED);
-            }
-            handleButtonEvent(buttonId, payload->btnState);
+    dmx_config_t config = DMX_CONFIG_DEFAULT;
+    dmx_personality_t personalities[] = {};
+    int personality_count = 0;
+    bool ret =  dmx_driver_install(dmxPort, &config, personalities, personality_count);
+    if (!ret) Serial.println("ERROR: Installing DMX driver");
+    ret = dmx_set_pin(dmxPort, PIN_DMX_TX, PIN_DMX_RX, PIN_DMX_EN);
+    if (!ret) Serial.println("ERROR: Setting DMX pins");
+
+    sceneRestored = prefs.getBytes("scene", bootScene, sizeof(bootScene)) == dmxSendSize && bootScene[0] == DMX_SC;
+    memcpy(dmxData, sceneRestored ? bootScene : effectDmx, sizeof(dmxData));
+    dmx_write(dmxPort, dmxData, dmxSendSize);
+    dmx_send_num(dmxPort, dmxSendSize);
+    bootUs[BOOT_SCENE] = esp_timer_get_time();
+
+    if (PIN_DMX_IN_RX >= 0) {
+        ret = dmx_driver_install(DMX_IN_PORT, &config, personalities, personality_count)
+            && dmx_set_pin(DMX_IN_PORT, DMX_PIN_NO_CHANGE, PIN_DMX_IN_RX, PIN_DMX_IN_EN);
+        if (ret) {
+            xTaskCreatePinnedToCore(dmxInputLoop, "dmx in", 4096, nullptr, DMX_IN_TASK_PRIORITY, nullptr, OUTPUT_TASK_CORE);
+        }
+        else {
+            Serial.println("ERROR: Installing DMX input");
         }
+    }
+}
 
-        buttonLastReceived[buttonId] = millis();
-        buttonLastState[buttonId] = payload->btnState;
+// radio in the background, DMX output and effects already run meanwhile
+void radioStart(void *) {
+    WiFi.mode(WIFI_STA);
+    if (NET_SSID) {
+        WiFi.begin(NET_SSID, NET_PASSWORD);
+    }
+    transport.onReceive(packetRx);
+    if (transport.begin()) {
+        transport.addPeer(TRANSPORT_BROADCAST);     // for the clock beacons
+        bootUs[BOOT_RADIO] = esp_timer_get_time();
+        radioReady = true;
     }
     else {
-        for (int i = 0; i < data_len; i++) {
-            Serial.printf("%02X ", data[i]);
+        Serial.println("Error initializing ESP-NOW");
+    }
+    vTaskDelete(nullptr);
+}
+
+void setup() {
+    // RS485 Transceiver enable
+    pinMode(19, OUTPUT);
+    digitalWrite(19, HIGH);
+    // 5V DCDC enable
+    pinMode(16, OUTPUT);
+    digitalWrite(16, HIGH);
+
+    Serial.setTxBufferSize(2048);   // room for the deferred log, so printing never blocks a frame
+    Serial.begin(921600);
+    prefs.begin("g2l");
+    startDmx();
+
+    pinMode(2, OUTPUT);
+    if (!ledDriver.begin()) {
+        Serial.println("ERROR: Starting LED driver");
+    }
+
+    loadButtons();
+    Serial.printf("%d buttons paired\n", buttonRegistry.count());
+    setSyncRole((SyncRole)prefs.getUChar("sync", SYNC_FOLLOWER));
+    xTaskCreatePinnedToCore(radioStart, "radio", 4096, nullptr, RADIO_TASK_PRIORITY, nullptr, OUTPUT_TASK_CORE);
+
+    // payload_t payload = {
+    //     .preamble = G2L_PREAMBLE,
+    // };
+
+    if (!ledMap.init(ledSegments, ledSegmentsNum)) {
+        Serial.println("ERROR: LED segments overlap or exceed the strip");
+    }
+
+    if (!fx.init(max(dmxPatch.numPixels(), ledMap.numPixels()))) {
+        Serial.printf("ERROR: More pixels than the effect engine's %d\n", FX_MAX_PIXELS);
+    }
+    // the restored scene fades into the background, which is there at full brightness already
+    if (sceneRestored) {
+        fx.skipIdleFade(showMillis());
+    }
+
+    // static channels of the patch go into every frame buffer
+    for (size_t i = 0; i < pipeline.size(); i++) {
+        memcpy(pipeline.buffer(i).dmx, effectDmx, sizeof(effectDmx));
+        pipeline.buffer(i).renderedUs = 0;
+    }
+    if (PIPELINED_OUTPUT) {
+        xTaskCreatePinnedToCore(outputLoop, "output", 4096, nullptr, OUTPUT_TASK_PRIORITY, &outputTask, OUTPUT_TASK_CORE);
+    }
+    lastSceneSave = millis();
+    bootUs[BOOT_SETUP] = esp_timer_get_time();
+}
+
+FrameScheduler frameScheduler(FRAME_RATE);
+OutputGate<sizeof(leds)> ledGate(LED_KEEPALIVE);
+OutputGate<sizeof(dmxData)> dmxGate(DMX_KEEPALIVE);
+uint32_t lastFrameStats = 0;
+NetOutput netOutput;
+bool netStarted = false, netFailed = false;
+
+// starts the network output once WiFi is up
+void updateNetOutput() {
+    if (!NET_SSID || netFailed || !radioReady) return;
+    if (!netStarted && WiFi.status() == WL_CONNECTED) {
+        netStarted = netOutput.begin(NET_PROTOCOL, NET_DEST) && netOutput.addUniverse(NET_UNIVERSE, dmxData, dmxSendSize);
+        if (!netStarted) {
+            netFailed = true;
+            Serial.println("ERROR: Starting network output");
         }
     }
-    Serial.println();
+    if (netStarted) {
+        netOutput.send(millis());
+    }
 }
 
-// if only the pressed/held, but no released events got received, release the button after a timeout
-void checkStuckButton() {
-    for (int i = 0; i < buttonNum; i++) {
-        if ((buttonLastState[i] == BTN_PRESSED || buttonLastState[i] == BTN_HOLD) && millis() - buttonLastReceived[i] > RX_TIMEOUT) {
-            buttonLastState[i] = BTN_RELEASED;
-            handleButtonEvent(i, BTN_RELEASED);
+void printFrameStats() {
+    const FrameScheduler::Stats &st = frameScheduler.stats();
+    Serial.printf("Frames: %u, late: %u, dropped: %u, jitter avg/max: %u/%uus, events dropped: %u\n",
+        st.frames, st.late, st.dropped, st.jitterAvgUs(), st.jitterMaxUs, buttonEvents.dropped());
+    Serial.printf("Output conversion: max %uus, %u frames over the %uus budget, %u frames skipped (output busy)\n",
+        convertMaxUs, convertOverBudget, CONVERT_BUDGET, outputBusy);
+    convertMaxUs = convertOverBudget = outputBusy = 0;
+    frameScheduler.resetStats();
+
+    // output side, from the snapshot the output took
+    if (outputStatsState == STATS_READY) {
+        const OutputStats &os = outputStats;
+        Serial.printf("Output: max %uus, LED push/skip: %u/%u, DMX send/skip: %u/%u\n",
+            os.maxUs, os.ledPushed, os.ledSkipped, os.dmxPushed, os.dmxSkipped);
+        Serial.printf("LED driver: %u frames, show max %uus, %u waited for the last frame, %uus on the wire\n",
+            os.led.frames, os.led.showMaxUs, os.led.waits, ledDriver.wireUs());
+        if (os.netStarted) {
+            Serial.printf("Net: sent: %u, skipped: %u, syncs: %u, errors: %u\n", os.net.sent, os.net.skipped, os.net.syncs, os.net.errors);
         }
+        outputStatsState = STATS_IDLE;
+    }
+    else {
+        Serial.println("Output: no frame taken since the last stats");
+    }
+
+    if (PIN_DMX_IN_RX >= 0) {
+        const DmxInputFrame *in = dmxInput.latest();
+        Serial.printf("DMX in: %u frames, %u errors, %s\n", dmxInFrames.exchange(0), dmxInErrors.exchange(0),
+            in && millis() - in->receivedMs < DMX_INPUT_TIMEOUT ? "signal" : "no signal");
+    }
+
+    const ShowClock::Stats &ss = showClock.stats();
+    if (syncRole == SYNC_MASTER) {
+        Serial.printf("Sync: master, beacon %u\n", beaconSeq);
+    }
+    else if (ss.beacons) {
+        Serial.printf("Sync: %s, beacons: %u, lost: %u, steps: %u, offset last/avg/max: %d/%u/%uus, drift: %dppb\n",
+            showClock.locked(esp_timer_get_time()) ? "locked" : "free running", ss.beacons, ss.lost, ss.steps,
+            ss.lastErrorUs, ss.errorAvgUs(), ss.errorMaxUs, showClock.ratePpb());
+        showClock.resetStats();
     }
 }
 
-CRGB *outputColor[] = {
-    // new CRGB(),
-    // new CRGB(),
-    // new CRGB(),
-    // new CRGB(),
+// press -> DMX out per button, stage averages: button (edge -> radio), queue (rx -> trigger),
+// render (trigger -> frame), out (frame -> DMX driver), LED (frame -> strip shown)
+void printLatency() {
+    for (int i = 0; i < LATENCY_BUTTONS && i < buttonRegistry.count(); i++) {
+        const LatencyTracer::ButtonStats &st = latency.stats(i);
+        if (!st.count) continue;
+        Serial.printf("B %d: %u presses, min/avg/p99/max %u/%u/%u/%uus, button %u, queue %u, render %u, out %u, LED %uus, %u without output change\n",
+            i, st.count, st.minUs, st.avgUs(), st.percentileUs(99), st.maxUs,
+            st.stageAvgUs(STAGE_BUTTON), st.stageAvgUs(STAGE_QUEUE), st.stageAvgUs(STAGE_RENDER), st.stageAvgUs(STAGE_OUTPUT),
+            st.ledCount ? st.ledSumUs / st.ledCount : 0, st.expired);
+    }
+}
 
-    (CRGB*)&(dmxPayload.fixtures[0].red),  // hackedy-hack
-    (CRGB*)&(dmxPayload.fixtures[1].red),
+// static RAM per subsystem. Effects, frames and queues are all sized at compile time, the
+// heap is left to WiFi and the drivers. The budgets are a plan for the C3, the smallest
+// target: the C3 has ~320k for data, WiFi, ESP-NOW, the task stacks and the drivers need
+// ~100k of heap and a margin is kept for fragmentation, which leaves MEMORY_BUDGET. Of that
+// the subsystems get their share below, with ~20k not handed out, each with room to grow
+// (more pixels, buttons, fixtures) before its static_assert asks for a new plan
+struct MemoryUse {
+    const char *name;
+    size_t bytes;
+    size_t budget;
 };
+constexpr MemoryUse memoryUse[] = {
+    { "effects",  sizeof(fx) + sizeof(effectStore) + sizeof(effects) + sizeof(rainbow)
+                  + sizeof(paletteLibrary),                                                         32 * 1024 },
+    { "DMX",      sizeof(dmxData) + sizeof(effectDmx) + sizeof(bootScene) + sizeof(pixels) + sizeof(dmxPatch)
+                  + sizeof(dmxMerge) + sizeof(dmxOutput) + sizeof(dmxInput) + sizeof(dmxGate),      24 * 1024 },
+    { "LED",      sizeof(leds) + sizeof(ledMap) + sizeof(ledFrame) + sizeof(ledOutput)
+                  + sizeof(rmtLedDriver) + sizeof(fastLedDriver) + sizeof(ledGate),                 8 * 1024 },
+    { "pipeline", sizeof(pipeline),                                                                 4 * 1024 },
+    { "buttons",  sizeof(buttonEvents) + sizeof(buttonRegistry) + sizeof(buttons) + sizeof(beaconRx)
+                  + sizeof(telemetry) + sizeof(linkWarnings),                                       32 * 1024 },
+    { "log",      sizeof(logger) + sizeof(recorder) + sizeof(latency),                              32 * 1024 },
+    { "network",  sizeof(netOutput),                                                                8 * 1024 },
+};
+constexpr size_t MEMORY_BUDGET = 160 * 1024;
 
-void setup() {
-    Serial.begin(921600);
-    pinMode(2, OUTPUT);
-    FastLED.addLeds<NEOPIXEL, DATA_PIN>(leds, NUM_LEDS).setCorrection(TypicalSMD5050);
-    FastLED.setBrightness(255);
+constexpr size_t memoryTotal() {
+    size_t total = 0;
+    for (const MemoryUse &m : memoryUse) total += m.bytes;
+    return total;
+}
+constexpr bool memoryWithinBudgets() {
+    for (const MemoryUse &m : memoryUse) {
+        if (m.bytes > m.budget) return false;
+    }
+    return true;
+}
+constexpr size_t memoryBudgets() {
+    size_t total = 0;
+    for (const MemoryUse &m : memoryUse) total += m.budget;
+    return total;
+}
+static_assert(memoryBudgets() <= MEMORY_BUDGET, "the subsystem budgets hand out more than MEMORY_BUDGET");
+static_assert(memoryWithinBudgets(), "a subsystem exceeds its RAM budget, see memoryUse");
+static_assert(memoryTotal() <= MEMORY_BUDGET, "static RAM exceeds MEMORY_BUDGET");
 
-    // RS485 Transceiver enable
-    pinMode(19, OUTPUT);
-    digitalWrite(19, HIGH);
-    // 5V DCDC enable
-    pinMode(16, OUTPUT);
-    digitalWrite(16, HIGH);
+void printMemory() {
+    for (const MemoryUse &m : memoryUse) {
+        Serial.printf("%-8s %6u of %6u bytes\n", m.name, (unsigned)m.bytes, (unsigned)m.budget);
+    }
+    Serial.printf("total    %6u of %6u bytes. Heap free: %u, min free: %u, largest block: %u\n",
+        (unsigned)memoryTotal(), (unsigned)MEMORY_BUDGET, ESP.getFreeHeap(), ESP.getMinFreeHeap(), ESP.getMaxAllocHeap());
+}
 
-    // Serial.println(mac2str(buttonMacAddr[0].data()));
-    // Serial.println(mac2str(buttonMacAddr[1].data()));
-    // uint8_t test[] = {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC};
-    // Serial.println(findMacIndex(test));
+// link health of every button with a history: "link" prints all, warnings come with the stats
+void printLinkWarnings(int buttonId, uint8_t warnings, const LinkTelemetry::Summary &ls) {
+    if (warnings & LINK_BATTERY_LOW) Serial.printf("WARNING: B %d battery low, %umV\n", buttonId, ls.lastBatteryMv);
+    if (warnings & LINK_WEAK) Serial.printf("WARNING: B %d weak link, RSSI avg %ddBm\n", buttonId, ls.rssi.avg);
+    if (warnings & LINK_DEGRADING) Serial.printf("WARNING: B %d link degrading, RSSI %ddBm recently, %ddBm avg\n", buttonId, ls.recentRssi, ls.rssi.avg);
+    if (warnings & LINK_LOSSY) Serial.printf("WARNING: B %d losing %d%% of its packets\n", buttonId, ls.lossPercent);
+}
 
-    for (int i = 0; i < buttonNum; i++) {
-        buttonLastState[i] = BTN_RELEASED;
+void checkLinkHealth() {
+    for (int i = 0; i < TELEMETRY_BUTTONS && i < buttonRegistry.count(); i++) {
+        LinkTelemetry::Summary ls = telemetry.summary(i);
+        printLinkWarnings(i, ls.warnings & ~linkWarnings[i], ls);
+        linkWarnings[i] = ls.warnings;
     }
+}
 
-    WiFi.mode(WIFI_STA);
-    if (esp_now_init() != ESP_OK) {
-        Serial.println("Error initializing ESP-NOW");
-        return;
+void printLinks() {
+    for (int i = 0; i < TELEMETRY_BUTTONS && i < buttonRegistry.count(); i++) {
+        LinkTelemetry::Summary ls = telemetry.summary(i);
+        if (!ls.samples) continue;
+        Serial.printf("B %d: %d packets, RSSI min/avg/p95 %d/%d/%ddBm, battery min/avg/p95 %d/%d/%dmV, interval min/avg/p95 %d/%d/%dms, loss %d%%\n",
+            i, ls.samples, ls.rssi.min, ls.rssi.avg, ls.rssi.p95, ls.batteryMv.min, ls.batteryMv.avg, ls.batteryMv.p95,
+            ls.intervalMs.min, ls.intervalMs.avg, ls.intervalMs.p95, ls.lossPercent);
+        printLinkWarnings(i, ls.warnings, ls);
     }
-    esp_now_register_recv_cb(espNowRx);
+}
 
-    for (int i = 0; i < fixturesNum; i++) {
-        dmxPayload.fixtures[i].master = 255;
+char serialCmd[32];
+int serialCmdLen = 0;
+
+// simple line based commands, e.g. "log 3"
+void handleSerialCommand(const char *cmd) {
+    int arg;
+    if (sscanf(cmd, "log %d", &arg) == 1 && arg >= LOG_NONE && arg <= LOG_DEBUG) {
+        logger.setLevel((LogLevel)arg);
+        Serial.printf("log level: %d\n", arg);
+    }
+    else if (strcmp(cmd, "rec start") == 0) {
+        recorder.start();
+        Serial.println("recording button events");
+    }
+    else if (strcmp(cmd, "rec stop") == 0) {
+        recorder.stop();
+        Serial.printf("recorded %u events\n", (unsigned)recorder.count());
     }
-    // dmxPayload.fixtures[0].uv = 42;
+    else if (strcmp(cmd, "rec dump") == 0) {
+        recorder.dump();
+    }
+    else if (strcmp(cmd, "pair start") == 0) {
+        pairing = true;
+        Serial.println("pairing: press a new button to add it");
+    }
+    else if (strcmp(cmd, "pair stop") == 0) {
+        pairing = false;
+        Serial.println("pairing stopped");
+    }
+    else if (strcmp(cmd, "pair list") == 0) {
+        for (int i = 0; i < buttonRegistry.count(); i++) {
+            Serial.printf("B %d: %s\n", i, mac2str(buttonRegistry.mac(i)));
+        }
+    }
+    else if (strcmp(cmd, "pair clear") == 0) {
+        // the tracker state of the old ids runs out via the release timeout
+        prefs.remove("buttons");
+        loadButtons();
+        telemetry.clear();
+        memset(linkWarnings, 0, sizeof(linkWarnings));
+        Serial.printf("buttons reset to the %d defaults\n", buttonRegistry.count());
+    }
+    else if (strcmp(cmd, "loss") == 0) {
+        // v2 buttons only, v1 packets carry no sequence number
+        for (int i = 0; i < buttonRegistry.count(); i++) {
+            const ButtonTracker::LinkStats &ls = buttons.linkStats(i);
+            if (!ls.packets) continue;
+            Serial.printf("B %d: packets: %u, repeats: %u, lost: %u (%u.%u%%), lost presses: %u, recovered pressed/released: %u/%u\n",
+                i, ls.packets, ls.duplicates, ls.lost, ls.lost * 100 / (ls.packets + ls.lost), ls.lost * 1000 / (ls.packets + ls.lost) % 10,
+                ls.lostPresses, ls.missedPresses, ls.missedReleases);
+        }
+    }
+    else if (strcmp(cmd, "link") == 0) {
+        printLinks();
+    }
+    else if (strcmp(cmd, "lat") == 0) {
+        printLatency();
+    }
+    else if (strcmp(cmd, "lat reset") == 0) {
+        latency.reset();
+        Serial.println("latency stats reset");
+    }
+    else if (strcmp(cmd, "sync master") == 0 || strcmp(cmd, "sync follow") == 0) {
+        setSyncRole(cmd[5] == 'm' ? SYNC_MASTER : SYNC_FOLLOWER);
+        prefs.putUChar("sync", syncRole);
+        Serial.printf("sync: %s\n", syncRole == SYNC_MASTER ? "master" : "follower");
+    }
+    else if (strcmp(cmd, "boot") == 0) {
+        printBoot();
+    }
+    else if (strcmp(cmd, "scene save") == 0) {
+        sceneSaveDue = true;
+        Serial.println("scene: saving the current output");
+    }
+    else if (strcmp(cmd, "scene clear") == 0) {
+        prefs.remove("scene");
+        lastSceneSave = millis();
+        Serial.println("scene: cleared, until the next save a boot only sends the static channels");
+    }
+    else if (strcmp(cmd, "mem") == 0) {
+        printMemory();
+    }
+    else {
+        Serial.println("commands: log <0=none|1=error|2=info|3=debug>, rec <start|stop|dump>, pair <start|stop|list|clear>, loss, link, lat [reset], sync <master|follow>, boot, scene <save|clear>, mem");
+    }
+}
 
+void readSerialCommands() {
+    while (Serial.available()) {
+        char c = Serial.read();
+        if (c == '\r' || c == '\n') {
+            if (serialCmdLen) {
+                serialCmd[serialCmdLen] = 0;
+                handleSerialCommand(serialCmd);
+                serialCmdLen = 0;
+            }
+        }
+        else if (serialCmdLen < (int)sizeof(serialCmd) - 1) {
+            serialCmd[serialCmdLen++] = c;
+        }
+    }
+}
 
-    dmx_config_t config = DMX_CONFIG_DEFAULT;
-    dmx_personality_t personalities[] = {};
-    int personality_count = 0;
-    bool ret =  dmx_driver_install(dmxPort, &config, personalities, personality_count);
-    if (!ret) Serial.println("ERROR: Installing DMX driver");
-    ret = dmx_set_pin(dmxPort, PIN_DMX_TX, PIN_DMX_RX, PIN_DMX_EN);
-    if (!ret) Serial.println("ERROR: Setting DMX pins");
+// after boot the restored scene crossfades to the live output. Snapshots for saving are
+// taken here, the flash write happens in idle time
+void updateScene(uint8_t *dmx) {
+    if (sceneFading) {
+        uint32_t elapsed = millis() - sceneFadeStart;
+        if (fx.effectRunning() || elapsed >= SCENE_FADE_TIME) {
+            sceneFading = false;
+        }
+        else {
+            uint8_t t = elapsed * 255 / SCENE_FADE_TIME;
+            for (int c = 1; c < dmxSendSize; c++) dmx[c] = lerp8(bootScene[c], dmx[c], t);
+        }
+    }
+    if (sceneSaveDue && !sceneFading && !fx.effectRunning()) {
+        memcpy(bootScene, dmx, sizeof(bootScene));
+        sceneSaveDue = false;
+        sceneSnapshot = true;
+    }
+}
 
-    // payload_t payload = {
-    //     .preamble = G2L_PREAMBLE,
-    // };
+void saveScene() {
+    prefs.putBytes("scene", bootScene, dmxSendSize);
+    sceneSnapshot = false;
+}
+
+// render side: effects, conversion and patch into the frame buffer
+void renderFrame(OutputFrame &frame) {
+    fx.loop(showMillis());
+
+    // 16 bit frame -> 8 bit per output, with gamma and dithering
+    uint32_t convertStart = micros();
+    dmxOutput.convert(fx.frame(), pixels, fx.numPixels());
+    ledMap.render(fx.frame(), ledFrame);
+    ledOutput.convert(ledFrame, frame.leds, NUM_LEDS);
+    uint32_t convertUs = micros() - convertStart;
+    if (convertUs > convertMaxUs) convertMaxUs = convertUs;
+    if (convertUs > CONVERT_BUDGET) convertOverBudget++;
+
+    // the console's newest frame, if there is one, is merged in the same frame: no added latency
+    dmxPatch.render(pixels, effectDmx);
+    const DmxInputFrame *console = PIN_DMX_IN_RX >= 0 ? dmxInput.latest() : nullptr;
+    if (console && millis() - console->receivedMs > DMX_INPUT_TIMEOUT) console = nullptr;
+    dmxMerge.merge(effectDmx, console ? console->data : nullptr, fx.effectRunning(), frame.dmx);
+    updateScene(frame.dmx);
+    frame.renderedUs = micros();
+    frame.ledShownUs = frame.dmxSentUs = 0;
+    latency.rendered(frame.renderedUs);
+}
+
+// output side: snapshot of the counters for the stats line, then they start over
+void takeOutputStats() {
+    outputStats = { .maxUs = outputMaxUs, .ledPushed = ledGate.pushed(), .ledSkipped = ledGate.skipped(),
+        .dmxPushed = dmxGate.pushed(), .dmxSkipped = dmxGate.skipped(), .led = ledDriver.stats(),
+        .netStarted = netStarted, .net = netOutput.stats() };
+    outputMaxUs = 0;
+    ledDriver.resetStats();
+    ledGate.resetStats();
+    dmxGate.resetStats();
+    netOutput.resetStats();
+}
+
+// output side: LED strip, DMX and network, each only if something changed. The output
+// task owns leds, dmxData, the gates and the output counters
+void pushOutputs(OutputFrame &frame) {
+    uint8_t wanted = STATS_WANTED;
+    if (outputStatsState.compare_exchange_strong(wanted, STATS_TAKING)) {
+        takeOutputStats();
+        outputStatsState = STATS_READY;
+    }
+    uint32_t start = micros();
+    memcpy(leds, frame.leds, sizeof(leds));
+    memcpy(dmxData, frame.dmx, sizeof(dmxData));
+
+    // the RMT driver sends the strip while DMX and network go out
+    if (ledGate.push(leds, millis())) {
+        uint32_t shownUs = ledDriver.show(leds);
+        if (ledGate.changed()) frame.ledShownUs = shownUs;
+    }
+
+    if (dmxGate.push(dmxData, millis())) {
+        // only up to the last patched channel, shorter frames allow a higher refresh rate
+        dmx_wait_sent(dmxPort, DMX_TIMEOUT_TICK);  // don't touch the buffer while the last frame is still going out
+        dmx_write(dmxPort, dmxData, dmxSendSize);
+        dmx_send_num(dmxPort, dmxSendSize);
+        if (dmxGate.changed()) frame.dmxSentUs = micros();     // a keepalive doesn't show a press
+    }
+    updateNetOutput();
+
+    uint32_t took = micros() - start;
+    if (took > outputMaxUs) outputMaxUs = took;
+}
 
-    fx.init((uint8_t**)outputColor, 2);
+// render side again, once the frame came back from the output
+void reportOutput(const OutputFrame &frame) {
+    if (frame.ledShownUs) latency.ledShown(frame.ledShownUs, frame.renderedUs);
+    if (frame.dmxSentUs) latency.dmxSent(frame.dmxSentUs, frame.renderedUs);
 }
 
-uint32_t lastRun = 0;
+// console input, blocks until the next frame. Only complete null start code frames are
+// taken, RDM and frames with errors are skipped
+void dmxInputLoop(void *) {
+    dmx_packet_t packet;
+    for (;;) {
+        if (!dmx_receive(DMX_IN_PORT, &packet, DMX_TIMEOUT_TICK)) continue;
+        if (packet.err || packet.sc != DMX_SC || packet.is_rdm) {
+            if (packet.err) dmxInErrors++;
+            continue;
+        }
+        DmxInputFrame &in = dmxInput.back();
+        size_t size = dmx_read(DMX_IN_PORT, in.data, packet.size);
+        memset(in.data + size, 0, DMX_PACKET_SIZE - size);    // consoles may send short frames
+        in.receivedMs = millis();
+        dmxInput.publish();
+        dmxInFrames++;
+    }
+}
+
+void outputLoop(void *) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (OutputFrame *frame = pipeline.next()) {
+            pushOutputs(*frame);
+            pipeline.release(frame);
+        }
+    }
+}
 
 void loop() {
-    checkStuckButton();
-    fx.loop();
-    // CRGB toFill = applyGamma_video(outputColor, 2.2);
-    // leds[0] = toFill;
-    for (int i = 2; i < 3; i++) leds[i] = *outputColor[0];
-    for (int i = 14; i < 15; i++) leds[i] = *outputColor[1];
-    // leds[0] = *outputColor[0];
-    FastLED.show();
+    if (!frameScheduler.due(showUs())) {
+        // idle time: print deferred log records, but keep a margin to the next frame
+        uint32_t idleUs = frameScheduler.usUntilDue(showUs());
+        if (idleUs > 500) {
+            logger.drain(idleUs - 500);
+            recorder.drain(frameScheduler.usUntilDue(showUs()) / 2);
+            readSerialCommands();
+            if (sceneSnapshot) saveScene();
+        }
+        // give the CPU away if there is enough time left, a tick may take up to 1ms
+        if (frameScheduler.usUntilDue(showUs()) > 2000) {
+            delay(1);
+        }
+        return;
+    }
 
+    if (!bootUs[BOOT_FIRST_FRAME]) {
+        bootUs[BOOT_FIRST_FRAME] = esp_timer_get_time();
+        sceneFading = sceneRestored;
+        sceneFadeStart = millis();
+    }
+    if (!bootReported && radioReady) {
+        bootReported = true;
+        printBoot();
+    }
+    if (millis() - lastSceneSave > SCENE_SAVE_INTERVAL) {
+        lastSceneSave = millis();
+        sceneSaveDue = true;
+    }
 
-    
-    dmx_write(dmxPort, &dmxPayload, sizeof(dmxPayload));
-    dmx_send_num(dmxPort, sizeof(dmxPayload));
-    // dmx_wait_sent(dmxPort, DMX_TIMEOUT_TICK);
-    
+    updateSync();
+    buttonDispatch.process();      // everything the receive callback queued since the last frame
+    buttons.checkStuck(millis());
+
+    if (PIPELINED_OUTPUT) {
+        OutputFrame *frame = pipeline.acquire();
+        if (frame) {
+            reportOutput(*frame);
+            renderFrame(*frame);
+            pipeline.publish(frame);
+            xTaskNotifyGive(outputTask);
+        }
+        else {
+            outputBusy++;
+        }
+    }
+    else {
+        OutputFrame &frame = pipeline.buffer(0);
+        renderFrame(frame);
+        pushOutputs(frame);
+        reportOutput(frame);
+    }
+    latency.expire(micros());
+
+    if (millis() - lastFrameStats > FRAME_STATS_INTERVAL) {
+        lastFrameStats = millis();
+        uint8_t idle = STATS_IDLE;      // a request the output didn't answer in time stays open
+        outputStatsState.compare_exchange_strong(idle, STATS_WANTED);
+        frameStatsDue = true;
+    }
+    // once the output took its snapshot, or without it if the output didn't take a frame
+    if (frameStatsDue && (outputStatsState == STATS_READY || millis() - lastFrameStats > OUTPUT_STATS_TIMEOUT)) {
+        frameStatsDue = false;
+        printFrameStats();
+        checkLinkHealth();
+    }
 }
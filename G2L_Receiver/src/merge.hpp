@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+#include "fixtures.hpp"
+
+// Merges a universe from a lighting console with the effect output, per channel. Rules
+// give channel ranges a merge mode, channels without a rule stay with the effects. At init
+// the rules are compiled into runs of the same mode, so a frame is one pass per run.
+
+enum MergeMode : uint8_t {
+    MERGE_EFFECT,       // effect output only, the default
+    MERGE_CONSOLE,      // console only
+    MERGE_HTP,          // highest takes precedence
+    MERGE_LTP,          // the source that changed last takes the channel
+    MERGE_OVERRIDE,     // the effects while a button effect runs, the console otherwise
+};
+
+struct MergeRule {
+    uint16_t first;     // DMX channels, 1..512
+    uint16_t last;
+    MergeMode mode;
+};
+
+static const uint32_t DMX_INPUT_TIMEOUT = 1250;     // ms, E1.11 loss of data: the effects take over again
+
+class DmxMerge {
+    public:
+    // returns false on overlapping or out of range rules
+    bool init(const MergeRule *rules, size_t rulesNum) {
+        MergeMode modes[DMX_UNIVERSE_SIZE] = {};
+        _size = 1;
+        for (size_t i = 0; i < rulesNum; i++) {
+            const MergeRule &rule = rules[i];
+            if (rule.first < 1 || rule.last < rule.first || rule.last > DMX_UNIVERSE_SIZE - 1) return false;
+            for (int c = rule.first; c <= rule.last; c++) {
+                if (modes[c] != MERGE_EFFECT) return false;
+                modes[c] = rule.mode;
+            }
+            if (rule.mode != MERGE_EFFECT && rule.last + 1 > _size) _size = rule.last + 1;
+        }
+
+        _numRuns = 0;
+        for (int c = 1; c < DMX_UNIVERSE_SIZE; c++) {
+            if (modes[c] == MERGE_EFFECT) continue;
+            if (_numRuns && _runs[_numRuns - 1].mode == modes[c] && _runs[_numRuns - 1].last == c - 1) {
+                _runs[_numRuns - 1].last = c;
+            }
+            else {
+                _runs[_numRuns++] = { (uint16_t)c, (uint16_t)c, modes[c] };
+            }
+        }
+        memset(_consoleLtp, 0, sizeof(_consoleLtp));
+        memset(_effectLtp, 0, sizeof(_effectLtp));
+        memset(_consoleOwns, 0, sizeof(_consoleOwns));
+        return true;
+    }
+
+    // out = effect merged with console (DMX_UNIVERSE_SIZE bytes each, start code included).
+    // console nullptr: no signal, out is the effect output
+    void merge(const uint8_t *effect, const uint8_t *console, bool effectRunning, uint8_t *out) {
+        memcpy(out, effect, DMX_UNIVERSE_SIZE);
+        if (!console) return;
+
+        for (int r = 0; r < _numRuns; r++) {
+            const MergeRule &run = _runs[r];
+            switch (run.mode) {
+                case MERGE_CONSOLE:
+                    memcpy(out + run.first, console + run.first, run.last - run.first + 1);
+                    break;
+                case MERGE_HTP:
+                    for (int c = run.first; c <= run.last; c++) out[c] = std::max(effect[c], console[c]);
+                    break;
+                case MERGE_LTP:
+                    for (int c = run.first; c <= run.last; c++) {
+                        if (console[c] != _consoleLtp[c]) _consoleOwns[c] = true;
+                        else if (effect[c] != _effectLtp[c]) _consoleOwns[c] = false;
+                        _consoleLtp[c] = console[c];
+                        _effectLtp[c] = effect[c];
+                        out[c] = _consoleOwns[c] ? console[c] : effect[c];
+                    }
+                    break;
+                case MERGE_OVERRIDE:
+                    if (!effectRunning) memcpy(out + run.first, console + run.first, run.last - run.first + 1);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    // bytes to send so every merged channel goes out, start code included
+    uint16_t size() const { return _size; }
+
+    protected:
+    MergeRule _runs[DMX_UNIVERSE_SIZE - 1];
+    int _numRuns = 0;
+    uint16_t _size = 1;
+    uint8_t _consoleLtp[DMX_UNIVERSE_SIZE];     // values of the last frame, to see which source changed
+    uint8_t _effectLtp[DMX_UNIVERSE_SIZE];
+    bool _consoleOwns[DMX_UNIVERSE_SIZE];
+};
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "fixtures.hpp"
+#include "scheduler.hpp"
+
+// Network DMX output: sends rendered universes as Art-Net (ArtDmx + ArtSync) or
+// sACN / E1.31 (data + universe sync) UDP packets. Uses plain BSD sockets, which
+// lwIP provides on the ESP32, so the same code runs on the host against a local
+// listener. Unchanged universes are only resent when their keepalive runs out.
+
+enum NetProtocol : uint8_t {
+    NET_ARTNET,
+    NET_SACN,
+};
+
+static const uint16_t ARTNET_PORT = 6454;
+static const uint16_t SACN_PORT = 5568;
+static const int NET_MAX_UNIVERSES = 8;
+static const int NET_KEEPALIVE = 800;   // ms, E1.31 wants a resend within 1s of an unchanged universe
+
+class NetOutput {
+    public:
+    struct Stats {
+        uint32_t sent = 0;
+        uint32_t skipped = 0;
+        uint32_t syncs = 0;
+        uint32_t errors = 0;
+    };
+
+    // destIp = nullptr: sACN goes to the per-universe multicast groups, Art-Net needs a
+    // (broadcast) address. syncUniverse = 0 disables sync packets
+    bool begin(NetProtocol protocol, const char *destIp, uint16_t port = 0, uint16_t syncUniverse = 0) {
+        end();
+        _protocol = protocol;
+        _syncUniverse = syncUniverse;
+        _multicast = !destIp;
+        if (_multicast && protocol != NET_SACN) return false;
+
+        memset(&_dest, 0, sizeof(_dest));
+        _dest.sin_family = AF_INET;
+        _dest.sin_port = htons(port ? port : (protocol == NET_ARTNET ? ARTNET_PORT : SACN_PORT));
+        if (destIp && inet_aton(destIp, &_dest.sin_addr) == 0) return false;
+
+        _sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (_sock < 0) return false;
+        int on = 1;
+        setsockopt(_sock, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+
+        // component ID, only needs to be stable for this sender
+        for (int i = 0; i < 16; i++) _cid[i] = 0x47 ^ (i * 0x3B);
+        return true;
+    }
+
+    void end() {
+        if (_sock >= 0) close(_sock);
+        _sock = -1;
+        _numUniverses = 0;
+    }
+
+    // frame: DMX_UNIVERSE_SIZE bytes (start code + 512 channels), size: bytes to send incl.
+    // start code (e.g. DmxPatch::size())
+    bool addUniverse(uint16_t universe, const uint8_t *frame, uint16_t size) {
+        if (_numUniverses >= NET_MAX_UNIVERSES || size < 2 || size > DMX_UNIVERSE_SIZE) return false;
+        Universe &u = _universes[_numUniverses++];
+        u.number = universe;
+        u.frame = frame;
+        u.size = size;
+        u.sequence = 0;
+        u.gate = OutputGate<DMX_UNIVERSE_SIZE>(NET_KEEPALIVE);
+        return true;
+    }
+
+    // call once per rendered frame
+    void send(uint32_t nowMs) {
+        if (_sock < 0) return;
+        bool anySent = false;
+        for (int i = 0; i < _numUniverses; i++) {
+            Universe &u = _universes[i];
+            if (!u.gate.push(u.frame, nowMs)) {
+                _stats.skipped++;
+                continue;
+            }
+            size_t len = _protocol == NET_ARTNET ? buildArtDmx(u) : buildSacnData(u);
+            sendPacket(len, u.number);
+            anySent = true;
+        }
+        if (anySent && _syncUniverse) {
+            size_t len = _protocol == NET_ARTNET ? buildArtSync() : buildSacnSync();
+            sendPacket(len, _syncUniverse);
+            _stats.syncs++;
+        }
+    }
+
+    const Stats &stats() const { return _stats; }
+    void resetStats() { _stats = Stats(); }
+
+    protected:
+    struct Universe {
+        uint16_t number;
+        const uint8_t *frame;
+        uint16_t size;
+        uint8_t sequence;
+        OutputGate<DMX_UNIVERSE_SIZE> gate;
+    };
+
+    void sendPacket(size_t len, uint16_t universe) {
+        sockaddr_in dest = _dest;
+        if (_multicast) {
+            dest.sin_addr.s_addr = htonl(0xEFFF0000 | universe);    // 239.255.<hi>.<lo>
+        }
+        if (sendto(_sock, _packet, len, 0, (sockaddr *)&dest, sizeof(dest)) == (ssize_t)len) {
+            _stats.sent++;
+        }
+        else {
+            _stats.errors++;
+        }
+    }
+
+    size_t buildArtHeader(uint16_t opcode) {
+        memcpy(_packet, "Art-Net", 8);
+        _packet[8] = opcode & 0xFF;     // little endian
+        _packet[9] = opcode >> 8;
+        _packet[10] = 0;                // protocol version 14
+        _packet[11] = 14;
+        return 12;
+    }
+
+    size_t buildArtDmx(Universe &u) {
+        size_t pos = buildArtHeader(0x5000);
+        uint16_t channels = u.size - 1;
+        uint16_t len = (channels + 1) & ~1;     // must be even, the frame buffer always has the spare byte
+        if (++u.sequence == 0) u.sequence = 1;  // 0 would disable sequencing
+        _packet[pos++] = u.sequence;
+        _packet[pos++] = 0;                     // physical port
+        _packet[pos++] = u.number & 0xFF;       // sub-net + universe
+        _packet[pos++] = (u.number >> 8) & 0x7F;// net
+        _packet[pos++] = len >> 8;
+        _packet[pos++] = len & 0xFF;
+        memcpy(_packet + pos, u.frame + 1, len);
+        return pos + len;
+    }
+
+    size_t buildArtSync() {
+        size_t pos = buildArtHeader(0x5200);
+        _packet[pos++] = 0;
+        _packet[pos++] = 0;
+        return pos;
+    }
+
+    static void put16(uint8_t *p, uint16_t v) { p[0] = v >> 8; p[1] = v & 0xFF; }
+    static void put32(uint8_t *p, uint32_t v) { put16(p, v >> 16); put16(p + 2, v & 0xFFFF); }
+
+    // E1.31 root layer, shared by data and sync packets
+    void buildSacnRoot(size_t total, uint32_t vector) {
+        static const uint8_t acnId[12] = { 0x41, 0x53, 0x43, 0x2D, 0x45, 0x31, 0x2E, 0x31, 0x37, 0x00, 0x00, 0x00 };
+        put16(_packet, 0x0010);     // preamble size
+        put16(_packet + 2, 0);      // postamble size
+        memcpy(_packet + 4, acnId, sizeof(acnId));
+        put16(_packet + 16, 0x7000 | (total - 16));
+        put32(_packet + 18, vector);
+        memcpy(_packet + 22, _cid, sizeof(_cid));
+    }
+
+    size_t buildSacnData(Universe &u) {
+        uint16_t slots = u.size;    // incl. start code
+        size_t total = 125 + slots;
+        buildSacnRoot(total, 0x00000004);
+
+        // framing layer
+        put16(_packet + 38, 0x7000 | (total - 38));
+        put32(_packet + 40, 0x00000002);
+        memset(_packet + 44, 0, 64);
+        strncpy((char *)_packet + 44, "G2L Receiver", 63);
+        _packet[108] = 100;                     // priority
+        put16(_packet + 109, _syncUniverse);
+        _packet[111] = u.sequence++;
+        _packet[112] = 0;                       // options
+        put16(_packet + 113, u.number);
+
+        // DMP layer
+        put16(_packet + 115, 0x7000 | (total - 115));
+        _packet[117] = 0x02;
+        _packet[118] = 0xA1;
+        put16(_packet + 119, 0);                // first property address
+        put16(_packet + 121, 1);                // address increment
+        put16(_packet + 123, slots);
+        memcpy(_packet + 125, u.frame, slots);
+        return total;
+    }
+
+    size_t buildSacnSync() {
+        size_t total = 49;
+        buildSacnRoot(total, 0x00000008);
+        put16(_packet + 38, 0x7000 | (total - 38));
+        put32(_packet + 40, 0x00000001);
+        _packet[44] = _syncSequence++;
+        put16(_packet + 45, _syncUniverse);
+        put16(_packet + 47, 0);                 // reserved
+        return total;
+    }
+
+    NetProtocol _protocol = NET_ARTNET;
+    int _sock = -1;
+    sockaddr_in _dest;
+    bool _multicast = false;
+    uint16_t _syncUniverse = 0;
+    uint8_t _syncSequence = 0;
+    uint8_t _cid[16];
+
+    Universe _universes[NET_MAX_UNIVERSES];
+    int _numUniverses = 0;
+    uint8_t _packet[125 + DMX_UNIVERSE_SIZE];
+    Stats _stats;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <FastLED.h>
+
+#include "compositor.hpp"
+
+// Reduces the 16 bit frame of the effect engine to 8 bit values for one output. The gamma
+// curve is a table built at compile time, white balance is a per channel scale on top.
+// With dithering the fraction left over is carried to the next frame per pixel and
+// channel, so at 100Hz the average light level keeps the full resolution.
+
+static const int OUTPUT_LUT_BITS = 12;
+static const int OUTPUT_LUT_SIZE = 1 << OUTPUT_LUT_BITS;
+
+// compile time pow(), good to ~1e-12 which is plenty for a 16 bit table
+constexpr double curveLn(double x) {
+    int exp2 = 0;
+    while (x >= 2) { x /= 2; exp2++; }
+    while (x < 1) { x *= 2; exp2--; }
+    // ln(x) = 2 atanh((x - 1) / (x + 1))
+    double t = (x - 1) / (x + 1), t2 = t * t, term = t, sum = 0;
+    for (int k = 1; k < 60; k += 2) {
+        sum += term / k;
+        term *= t2;
+    }
+    return 2 * sum + exp2 * 0.69314718055994530942;
+}
+
+constexpr double curveExp(double y) {
+    // e^y = 2^n * e^r, |r| <= ln2 / 2
+    int n = (int)(y / 0.69314718055994530942 + (y < 0 ? -0.5 : 0.5));
+    double r = y - n * 0.69314718055994530942, term = 1, sum = 1;
+    for (int k = 1; k < 30; k++) {
+        term *= r / k;
+        sum += term;
+    }
+    for (; n > 0; n--) sum *= 2;
+    for (; n < 0; n++) sum /= 2;
+    return sum;
+}
+
+struct OutputCurve {
+    uint16_t lut[OUTPUT_LUT_SIZE];  // 16 bit input >> (16 - OUTPUT_LUT_BITS) -> 8.8 fixed point, 255.0 max
+};
+
+constexpr OutputCurve makeOutputCurve(double gamma) {
+    OutputCurve curve = {};
+    for (int i = 0; i < OUTPUT_LUT_SIZE; i++) {
+        double x = (double)i / (OUTPUT_LUT_SIZE - 1);
+        double y = (i == 0 || gamma == 1.0) ? x : curveExp(gamma * curveLn(x));
+        curve.lut[i] = (uint16_t)(y * 255 * 256 + 0.5);
+    }
+    return curve;
+}
+
+// N: most pixels this output converts
+template <size_t N>
+class OutputConverter {
+    public:
+    // balance: per channel scale as 0xRRGGBB, like FastLED's colour correction
+    OutputConverter(const OutputCurve &curve, uint32_t balance, bool dither)
+        : _curve(curve), _dither(dither) {
+        _balance[0] = ((balance >> 16) & 0xFF) + 1;
+        _balance[1] = ((balance >> 8) & 0xFF) + 1;
+        _balance[2] = (balance & 0xFF) + 1;
+    }
+
+    void reset() { memset(_error, 0, sizeof(_error)); }     // forget the dither state
+
+    void convert(const RGB16 *in, CRGB *out, size_t n) {
+        if (n > N) n = N;
+        for (size_t i = 0; i < n; i++) {
+            out[i].r = channel(in[i].r, 0, _error[i][0]);
+            out[i].g = channel(in[i].g, 1, _error[i][1]);
+            out[i].b = channel(in[i].b, 2, _error[i][2]);
+        }
+    }
+
+    protected:
+    uint8_t channel(uint16_t v, int c, uint8_t &error) const {
+        uint32_t fixed = ((uint32_t)_curve.lut[v >> (16 - OUTPUT_LUT_BITS)] * _balance[c]) >> 8;
+        if (!_dither) {
+            return (fixed + 128) >> 8;
+        }
+        // first order sigma-delta over time, 255.0 is the maximum so this can't overflow
+        uint32_t sum = (fixed & 0xFF) + error;
+        error = sum & 0xFF;
+        return (fixed >> 8) + (sum >> 8);
+    }
+
+    const OutputCurve &_curve;
+    uint16_t _balance[3];
+    bool _dither;
+    uint8_t _error[N][3] = {};
+};
+
+// the rig's outputs. Dithering needs the high frame rate, below ~100Hz it starts to flicker
+static const uint32_t DMX_BALANCE = 0xFFFFFF;
+static const bool DMX_DITHER = true;
+static constexpr OutputCurve dmxCurve = makeOutputCurve(1.0);  // the fixtures do their own dimming curve
+static const uint32_t LED_BALANCE = 0xFFB0F0;                   // FastLED's TypicalSMD5050
+static const bool LED_DITHER = true;
+static constexpr OutputCurve ledCurve = makeOutputCurve(2.2);
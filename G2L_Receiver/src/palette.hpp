@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <FastLED.h>
+
+// Colour palettes as gradients. A palette is a list of colour stops, at init every palette
+// is expanded into a 256 entry lookup table, so looking up a colour is a single table read.
+// PaletteFader crossfades between two palettes: once per frame it blends the two tables
+// (and an optional brightness) into one, pixels then only read that table.
+
+static const int PALETTE_MAX = 8;
+static const int PALETTE_MAX_STOPS = 8;
+
+struct PaletteStop {
+    uint8_t pos;        // 0..255 along the gradient
+    CRGB color;
+};
+
+struct Palette {
+    uint8_t numStops;
+    PaletteStop stops[PALETTE_MAX_STOPS];   // ascending pos
+};
+
+// a + (b - a) * t / 255, t = 0 gives a and t = 255 gives b
+inline uint8_t lerp8(uint8_t a, uint8_t b, uint8_t t) { return a + ((b - a) * t + (b > a ? 127 : -127)) / 255; }
+inline CRGB lerpRGB(const CRGB &a, const CRGB &b, uint8_t t) { return CRGB(lerp8(a.r, b.r, t), lerp8(a.g, b.g, t), lerp8(a.b, b.b, t)); }
+
+class PaletteLibrary {
+    public:
+    // returns false on more than PALETTE_MAX palettes or palettes without stops, the
+    // palettes up to there are usable
+    bool init(const Palette *palettes, int palettesNum) {
+        _count = 0;
+        for (int p = 0; p < palettesNum && p < PALETTE_MAX; p++) {
+            if (!palettes[p].numStops || palettes[p].numStops > PALETTE_MAX_STOPS) return false;
+            build(palettes[p], _luts[p]);
+            _count++;
+        }
+        return palettesNum <= PALETTE_MAX;
+    }
+
+    const CRGB *lut(int id) const { return _luts[id]; }
+    int count() const { return _count; }
+
+    protected:
+    static void build(const Palette &palette, CRGB *lut) {
+        const PaletteStop *stops = palette.stops;
+        int s = 0;
+        for (int i = 0; i < 256; i++) {
+            while (s + 1 < palette.numStops && stops[s + 1].pos <= i) s++;
+            if (i <= stops[0].pos || s + 1 == palette.numStops) {
+                lut[i] = i <= stops[0].pos ? stops[0].color : stops[s].color;
+                continue;
+            }
+            const PaletteStop &a = stops[s], &b = stops[s + 1];
+            lut[i] = lerpRGB(a.color, b.color, (i - a.pos) * 255 / (b.pos - a.pos));
+        }
+    }
+
+    CRGB _luts[PALETTE_MAX][256];
+    int _count = 0;
+};
+
+static inline PaletteLibrary paletteLibrary;
+
+class PaletteFader {
+    public:
+    // fades from what is shown now to palette id over fadeTime ms, 0 switches at once
+    void select(int id, uint32_t now, uint32_t fadeTime) {
+        _from = _to;    // a fade still in progress jumps to its target
+        _to = id;
+        _fadeStart = now;
+        _fadeTime = fadeTime;
+        _table = paletteLibrary.lut(_from);     // not the blended table, so the next update() builds it
+    }
+
+    // builds this frame's table, everything read with color() until the next update()
+    void update(uint32_t now, uint8_t bright = 255) {
+        uint8_t t = fading(now) ? (uint64_t)(now - _fadeStart) * 255 / _fadeTime : 255;
+        if (t == 255 && bright == 255) {
+            _table = paletteLibrary.lut(_to);       // no blending needed, read the palette directly
+            return;
+        }
+        if (_table == _blended && t == _lastT && bright == _lastBright) return;
+
+        const CRGB *from = paletteLibrary.lut(_from), *to = paletteLibrary.lut(_to);
+        for (int i = 0; i < 256; i++) {
+            _blended[i] = lerpRGB(from[i], to[i], t).scale8(bright);
+        }
+        _table = _blended;
+        _lastT = t;
+        _lastBright = bright;
+    }
+
+    CRGB color(uint8_t index) const { return _table[index]; }
+    int current() const { return _to; }
+    bool fading(uint32_t now) const { return now - _fadeStart < _fadeTime; }
+
+    protected:
+    int _from = 0, _to = 0;
+    uint32_t _fadeStart = 0, _fadeTime = 0;
+    const CRGB *_table = paletteLibrary.lut(0);
+    CRGB _blended[256];
+    uint8_t _lastT = 0, _lastBright = 0;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#include "ringbuffer.hpp"
+
+// Frame buffers shared between the render loop and an output task on the other core.
+// Buffers travel by index through two SPSC rings (render -> output: ready, output ->
+// render: free), so whoever holds a buffer owns it and no locks are needed. With two
+// buffers the render loop fills one while the output task sends the other.
+template <typename Frame, size_t N = 2>
+class FramePipeline {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "buffer count must be a power of two");
+
+    public:
+    FramePipeline() {
+        for (size_t i = 0; i < N; i++) _free.push(i);
+    }
+
+    // render side: a buffer to render into, nullptr while the output still has all of
+    // them. It comes back with the output side's results of its last round
+    Frame *acquire() {
+        uint8_t idx;
+        return _free.pop(idx) ? &_frames[idx] : nullptr;
+    }
+    void publish(Frame *frame) { _ready.push(frame - _frames); }
+
+    // output side, oldest rendered frame first
+    Frame *next() {
+        uint8_t idx;
+        return _ready.pop(idx) ? &_frames[idx] : nullptr;
+    }
+    void release(Frame *frame) { _free.push(frame - _frames); }
+
+    // e.g. to set up static content in every buffer before the tasks start
+    Frame &buffer(size_t i) { return _frames[i]; }
+    static constexpr size_t size() { return N; }
+
+    protected:
+    Frame _frames[N];
+    SpscRing<uint8_t, N> _ready;
+    SpscRing<uint8_t, N> _free;
+};
+
+// Latest-value handover of frames that arrive at their own rate (DMX input). The writer
+// fills its back buffer and publishes it, the reader always gets the newest complete
+// frame, in place. Three buffers, so neither side ever waits or sees a half written frame;
+// frames the reader didn't get to are simply replaced.
+template <typename Frame>
+class TripleBuffer {
+    public:
+    // writer side
+    Frame &back() { return _frames[_back]; }
+    void publish() { _back = _middle.exchange(_back | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+    // reader side: the newest published frame, valid until the next call. nullptr before
+    // the first one
+    const Frame *latest() {
+        if (_middle.load(std::memory_order_relaxed) & FRESH) {
+            _front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX;
+            _valid = true;
+        }
+        return _valid ? &_frames[_front] : nullptr;
+    }
+
+    protected:
+    static const uint8_t INDEX = 0x03;
+    static const uint8_t FRESH = 0x04;
+
+    Frame _frames[3];
+    uint8_t _back = 0;                      // writer only
+    uint8_t _front = 1;                     // reader only
+    std::atomic<uint8_t> _middle{2};
+    bool _valid = false;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+#include "compositor.hpp"
+
+// Maps effect engine pixels onto an LED strip. The strip is split into segments, each one
+// shows a range of effect pixels stretched over its LEDs (spread) or stretched over the
+// first half and mirrored into the second (mirror). LEDs between two effect pixels are
+// interpolated, so a few pixels make a smooth gradient. Like the DMX patch the map is
+// compiled at init into one source entry per LED.
+
+enum MapMode : uint8_t {
+    MAP_SPREAD,     // first pixel on the first LED, last pixel on the last
+    MAP_MIRROR,     // first pixel on both ends, last pixel in the middle
+};
+
+struct LedSegment {
+    uint16_t first;         // first LED of the segment
+    uint16_t length;        // LEDs
+    uint16_t pixel;         // first effect pixel
+    uint16_t numPixels;     // effect pixels shown, 1 fills the whole segment
+    MapMode mode;
+    int16_t offset;         // rotates the segment by this many LEDs, wrapping around
+    bool reverse;           // last pixel on the first LED
+};
+
+// N: LEDs on the strip
+template <size_t N>
+class PixelMap {
+    public:
+    // returns false on overlapping segments or ones beyond the strip. LEDs outside all
+    // segments stay black
+    bool init(const LedSegment *segments, size_t segmentsNum) {
+        for (Source &s : _sources) s = { NO_PIXEL, 0 };
+        _numPixels = 0;
+
+        for (size_t i = 0; i < segmentsNum; i++) {
+            const LedSegment &seg = segments[i];
+            if (seg.length == 0 || seg.numPixels == 0 || seg.first + seg.length > N) return false;
+            for (int j = 0; j < seg.length; j++) {
+                if (_sources[seg.first + j].pixel != NO_PIXEL) return false;
+            }
+
+            // positions in 1/256 effect pixels along the (half) segment
+            int span = seg.mode == MAP_MIRROR ? (seg.length + 1) / 2 : seg.length;
+            for (int j = 0; j < seg.length; j++) {
+                int k = seg.mode == MAP_MIRROR ? std::min(j, seg.length - 1 - j) : j;
+                uint32_t pos = span > 1 ? (uint32_t)k * (seg.numPixels - 1) * 256 / (span - 1) : 0;
+                if (seg.reverse) pos = (seg.numPixels - 1) * 256 - pos;
+
+                int led = ((j + seg.offset) % seg.length + seg.length) % seg.length;
+                _sources[seg.first + led] = { (uint16_t)(seg.pixel + (pos >> 8)), (uint8_t)pos };
+            }
+            if (seg.pixel + seg.numPixels > _numPixels) _numPixels = seg.pixel + seg.numPixels;
+        }
+        return true;
+    }
+
+    // frame: the effect engine output, at least numPixels() pixels
+    void render(const RGB16 *frame, RGB16 *leds) const {
+        for (size_t i = 0; i < N; i++) {
+            const Source &s = _sources[i];
+            if (s.pixel == NO_PIXEL) {
+                leds[i] = { 0, 0, 0 };
+            }
+            else if (s.frac == 0) {
+                leds[i] = frame[s.pixel];
+            }
+            else {
+                const RGB16 &a = frame[s.pixel], &b = frame[s.pixel + 1];
+                leds[i] = { lerp(a.r, b.r, s.frac), lerp(a.g, b.g, s.frac), lerp(a.b, b.b, s.frac) };
+            }
+        }
+    }
+
+    uint16_t numPixels() const { return _numPixels; }    // effect pixels the map needs
+    static constexpr size_t size() { return N; }
+
+    protected:
+    static const uint16_t NO_PIXEL = 0xFFFF;
+
+    struct Source {
+        uint16_t pixel;
+        uint8_t frac;       // towards pixel + 1, in 1/256
+    };
+
+    static uint16_t lerp(uint16_t a, uint16_t b, uint8_t frac) {
+        return a + (((int32_t)b - a) * frac >> 8);
+    }
+
+    Source _sources[N];
+    uint16_t _numPixels = 0;
+};
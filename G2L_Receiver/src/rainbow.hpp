@@ -0,0 +1,36 @@
+#pragma once
+
+#include <FastLED.h>
+
+// Rainbow colour source for the idle background and FXRainbowFlash.
+// The hue is a 32 bit phase (one full revolution = 2^32), updated once per frame from
+// the frame timestamp. Pixels are spread by a fixed phase step, and colours are read
+// from hue->RGB tables, so the per-pixel path needs no division or HSV conversion.
+class RainbowGenerator {
+    public:
+    void init(uint16_t numPixels, uint32_t period) {
+        _period = period;
+        _pixelStep = numPixels ? ((uint64_t)(period / numPixels) << 32) / period : 0;
+
+        for (int i = 0; i < 256; i++) {
+            // the old per-pixel mapping scaled the hue to 0..254, keep that look
+            hsv2rgb_rainbow(CHSV(i * 255 / 256, 240, 255), _lutFull[i]);    // sat=240 taken from FastLED fill_rainbow, idk
+        }
+    }
+
+    void update(uint32_t now) {
+        _phase = ((uint64_t)(now % _period) << 32) / _period;
+    }
+
+    CRGB color(uint16_t idx) const { return _lutFull[hue(idx)]; }     // full brightness
+
+    uint8_t hue(uint16_t idx) const { return (_phase + idx * _pixelStep) >> 24; }
+
+    protected:
+    uint32_t _period = 1;
+    uint32_t _phase = 0;
+    uint32_t _pixelStep = 0;
+    CRGB _lutFull[256];
+};
+
+static inline RainbowGenerator rainbow;
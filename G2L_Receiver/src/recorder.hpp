@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "events.hpp"
+
+// Records the button events coming out of the receive callback, for offline replay
+// (see replay/replay.cpp). The dump is plain text on the serial port, one
+// "rec <time> <button> <state> [<seq> <press count>]" line per event (the last two for
+// v2 packets only), so a captured monitor log can be fed to the replayer as is. Only the
+// fields of the dump are kept, not the whole ButtonEvent.
+
+inline bool parseRecordLine(const char *line, ButtonEvent &ev) {
+    unsigned time, buttonId, btnState, seq, pressCount;
+    int fields = sscanf(line, "rec %u %u %u %u %u", &time, &buttonId, &btnState, &seq, &pressCount);
+    if (fields != 3 && fields != 5) return false;
+    ev = { .time = time, .mac = {}, .buttonId = (uint8_t)buttonId, .btnState = (uint8_t)btnState, .version = 1 };
+    if (fields == 5) {
+        ev.version = G2L_PROTOCOL_V2;
+        ev.seq = seq;
+        ev.pressCount = pressCount;
+    }
+    return true;
+}
+
+template <size_t N>
+class EventRecorder {
+    // what a "rec" line needs, 12 instead of 32 bytes per event
+    struct Entry {
+        uint32_t time;
+        uint16_t seq;
+        uint16_t pressCount;
+        uint8_t buttonId;
+        uint8_t btnState;
+        uint8_t version;
+    };
+
+    public:
+    void start() {
+        _count = 0;
+        _overflow = 0;
+        _recording = true;
+    }
+    void stop() { _recording = false; }
+    bool recording() const { return _recording; }
+
+    void record(const ButtonEvent &ev) {
+        if (!_recording) return;
+        if (_count < N) {
+            _events[_count++] = { .time = ev.time, .seq = ev.seq, .pressCount = ev.pressCount,
+                .buttonId = ev.buttonId, .btnState = ev.btnState, .version = ev.version };
+        }
+        else {
+            _overflow++;
+        }
+    }
+
+    size_t count() const { return _count; }
+    uint32_t overflow() const { return _overflow; }
+
+    // start printing the recording, the lines go out from drain()
+    void dump() {
+        _dumpPos = 0;
+        _dumping = true;
+        Serial.printf("rec begin: %u events, %u not recorded (buffer full)\n", (unsigned)_count, (unsigned)_overflow);
+    }
+
+    void drain(uint32_t budgetUs) {
+        uint32_t start = micros();
+        while (_dumping && micros() - start < budgetUs && Serial.availableForWrite() >= 32) {
+            if (_dumpPos >= _count) {
+                Serial.println("rec end");
+                _dumping = false;
+                break;
+            }
+            const Entry &ev = _events[_dumpPos++];
+            if (ev.version >= G2L_PROTOCOL_V2) {
+                Serial.printf("rec %u %u %u %u %u\n", (unsigned)ev.time, ev.buttonId, ev.btnState, ev.seq, ev.pressCount);
+            }
+            else {
+                Serial.printf("rec %u %u %u\n", (unsigned)ev.time, ev.buttonId, ev.btnState);
+            }
+        }
+    }
+
+    protected:
+    Entry _events[N];
+    size_t _count = 0;
+    uint32_t _overflow = 0;
+    bool _recording = false;
+    bool _dumping = false;
+    size_t _dumpPos = 0;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Fixed-size single-producer/single-consumer queue. push() and pop() are lock- and
+// allocation-free, so the producer may run in a callback on another task (e.g. WiFi).
+// When full, new items are dropped and counted.
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "ring size must be a power of two");
+
+    public:
+    // producer side
+    bool push(const T &item) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= N) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        _items[head & (N - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side
+    bool pop(T &item) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = _items[tail & (N - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+    static constexpr size_t capacity() { return N; }
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+    protected:
+    T _items[N];
+    std::atomic<uint32_t> _head{0}, _tail{0};
+    std::atomic<uint32_t> _dropped{0};
+};
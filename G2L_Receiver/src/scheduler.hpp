@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Fixed-rate frame timing. Frames are phase locked to a fixed grid of `period` us,
+// so a late frame doesn't shift all following ones. Whole periods that were missed
+// count as dropped frames, frames starting later than half a period count as late.
+// The grid is aligned to multiples of the period, so receivers sharing a show clock
+// render their frames at the same time. Times are 64 bit us, so the grid never wraps.
+
+static const uint64_t FRAME_REGRID_US = 1000000;    // the clock jumping ahead further than this was stepped, not stalled
+
+class FrameScheduler {
+    public:
+    struct Stats {
+        uint32_t frames = 0;
+        uint32_t late = 0;
+        uint32_t dropped = 0;
+        uint32_t jitterMaxUs = 0;   // start delay vs. the frame grid
+        uint64_t jitterSumUs = 0;
+
+        uint32_t jitterAvgUs() const { return frames ? jitterSumUs / frames : 0; }
+    };
+
+    FrameScheduler(uint32_t rateHz) { setRate(rateHz); }
+
+    void setRate(uint32_t rateHz) {
+        _periodUs = 1000000 / rateHz;
+        _started = false;
+    }
+    uint32_t periodUs() const { return _periodUs; }
+
+    // true when the next frame should be rendered, call as often as possible
+    bool due(uint64_t nowUs) {
+        // the clock was stepped (show clock sync), back by more than a frame or far ahead:
+        // start a new grid instead of waiting or counting drops
+        if (!_started || nowUs + _periodUs < _nextUs || nowUs > _nextUs + FRAME_REGRID_US) {
+            _started = true;
+            _nextUs = nowUs - nowUs % _periodUs;
+        }
+        if (nowUs < _nextUs) return false;
+
+        uint32_t delayUs = nowUs - _nextUs;
+        uint32_t missed = delayUs / _periodUs;
+        uint32_t jitterUs = delayUs % _periodUs;
+        _nextUs += (uint64_t)(missed + 1) * _periodUs;
+
+        _stats.frames++;
+        _stats.dropped += missed;
+        if (jitterUs > _periodUs / 2) _stats.late++;
+        if (jitterUs > _stats.jitterMaxUs) _stats.jitterMaxUs = jitterUs;
+        _stats.jitterSumUs += jitterUs;
+        return true;
+    }
+
+    // time left until the next frame, e.g. to sleep or do background work
+    uint32_t usUntilDue(uint64_t nowUs) const {
+        return nowUs < _nextUs ? _nextUs - nowUs : 0;
+    }
+
+    const Stats &stats() const { return _stats; }
+    void resetStats() { _stats = Stats(); }
+
+    protected:
+    uint32_t _periodUs;
+    uint64_t _nextUs = 0;
+    bool _started = false;
+    Stats _stats;
+};
+
+// Change detection for an output buffer: push() tells whether the buffer differs from
+// what was last pushed, or whether the keepalive interval ran out (0 = no keepalive).
+// changed() tells the two apart for the last push that returned true.
+template <size_t N>
+class OutputGate {
+    public:
+    OutputGate(uint32_t keepaliveMs = 0) : _keepaliveMs(keepaliveMs) { }
+
+    bool push(const void *data, uint32_t nowMs) {
+        bool changed = !_valid || memcmp(_last, data, N) != 0;
+        if (!changed && !(_keepaliveMs && nowMs - _lastPush >= _keepaliveMs)) {
+            _skipped++;
+            return false;
+        }
+        if (changed) memcpy(_last, data, N);
+        _changed = changed;
+        _valid = true;
+        _lastPush = nowMs;
+        _pushed++;
+        return true;
+    }
+
+    bool changed() const { return _changed; }      // false: a keepalive resend
+    uint32_t pushed() const { return _pushed; }
+    uint32_t skipped() const { return _skipped; }
+    void resetStats() { _pushed = _skipped = 0; }
+
+    protected:
+    uint8_t _last[N];
+    bool _valid = false;
+    bool _changed = false;
+    uint32_t _keepaliveMs;
+    uint32_t _lastPush = 0;
+    uint32_t _pushed = 0, _skipped = 0;
+};
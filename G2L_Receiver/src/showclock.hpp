@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdint.h>
+
+// Show clock shared by several receivers, so effects on all of them run in phase. One
+// receiver is the master: its show clock is its own timer, and it broadcasts it in clock
+// beacons. The followers discipline their show clock to the beacons: large errors step
+// the clock, small ones are slewed out over a few beacons while the rate correction learns
+// the crystal drift. Without beacons the clock keeps running at the learned rate.
+// Times are 64 bit us, the local time comes from esp_timer_get_time() (or a simulation).
+
+static const uint32_t SYNC_BEACON_INTERVAL = 250;       // ms between beacons of the master
+static const uint32_t SYNC_BEACON_LATENCY_US = 350;     // rough send call -> receive callback, the same for every follower
+static const int32_t SYNC_STEP_US = 5000;               // errors above this step the clock
+static const int32_t SYNC_MAX_SLEW_US = 500;            // larger errors (radio retries) only count this much
+static const int SYNC_PHASE_SHIFT = 3;                  // 1/8 of the offset is taken out per beacon
+static const int SYNC_RATE_SHIFT = 8;                   // 1/256 of the rate error seen at a beacon goes into the rate, so latency jitter averages out
+static const int32_t SYNC_MAX_RATE_PPB = 200000;        // crystals are within +-40ppm, so this is plenty
+static const uint32_t SYNC_LOCK_TIMEOUT_MS = 2000;      // without beacons for this long the clock is free running
+
+enum SyncRole : uint8_t {
+    SYNC_FOLLOWER,  // follows a master if there is one, free running otherwise
+    SYNC_MASTER,
+};
+
+class ShowClock {
+    public:
+    struct Stats {
+        uint32_t beacons = 0;
+        uint32_t lost = 0;          // gaps in the beacon sequence
+        uint32_t steps = 0;
+        int32_t lastErrorUs = 0;    // offset to the master at the last beacon, before correcting
+        uint32_t errorMaxUs = 0;
+        uint64_t errorSumUs = 0;    // of |error|, slewed beacons only
+
+        uint32_t errorAvgUs() const { return beacons > steps ? errorSumUs / (beacons - steps) : 0; }
+    };
+
+    // show time at local time localUs
+    uint64_t now(uint64_t localUs) const {
+        int64_t dt = localUs - _localAnchor;
+        return _showAnchor + dt + dt * _ratePpb / 1000000000;
+    }
+
+    // master side: keep running from where the clock is now, at the nominal rate
+    void setMaster(uint64_t localUs) {
+        anchor(localUs, now(localUs));
+        _ratePpb = 0;
+        _synced = false;
+    }
+
+    // follower side: a beacon stamped with showUs by the master arrived at localUs
+    void beacon(uint64_t showUs, uint8_t seq, uint64_t localUs) {
+        if (_stats.beacons && (uint8_t)(seq - _lastSeq) > 1) _stats.lost += (uint8_t)(seq - _lastSeq) - 1;
+        _lastSeq = seq;
+        _stats.beacons++;
+
+        uint64_t target = showUs + SYNC_BEACON_LATENCY_US;
+        int64_t error = (int64_t)(target - now(localUs));
+        _stats.lastErrorUs = error;
+        if (!_synced || error > SYNC_STEP_US || error < -SYNC_STEP_US) {
+            // first beacon, or the master restarted: jump, the rate can't be judged yet
+            _stats.steps++;
+            _synced = true;
+            _lastBeaconUs = localUs;
+            anchor(localUs, target);
+            return;
+        }
+
+        uint32_t absError = error < 0 ? -error : error;
+        if (absError > _stats.errorMaxUs) _stats.errorMaxUs = absError;
+        _stats.errorSumUs += absError;
+
+        // a late beacon (e.g. a retry on the radio) looks like a large error, don't trust it too much
+        if (error > SYNC_MAX_SLEW_US) error = SYNC_MAX_SLEW_US;
+        if (error < -SYNC_MAX_SLEW_US) error = -SYNC_MAX_SLEW_US;
+
+        // offsets that keep coming back are a rate error, integrate them into the rate
+        int64_t interval = localUs - _lastBeaconUs;
+        if (interval > 0) {
+            int64_t rate = _ratePpb + (error * 1000000000 / interval >> SYNC_RATE_SHIFT);
+            _ratePpb = rate > SYNC_MAX_RATE_PPB ? SYNC_MAX_RATE_PPB : rate < -SYNC_MAX_RATE_PPB ? -SYNC_MAX_RATE_PPB : rate;
+        }
+        _lastBeaconUs = localUs;
+        anchor(localUs, now(localUs) + (error >> SYNC_PHASE_SHIFT));
+    }
+
+    // following a master right now
+    bool locked(uint64_t localUs) const {
+        return _synced && localUs - _lastBeaconUs < SYNC_LOCK_TIMEOUT_MS * 1000ULL;
+    }
+
+    int32_t ratePpb() const { return _ratePpb; }    // learned local clock error, + = local clock slow
+    const Stats &stats() const { return _stats; }
+    void resetStats() { _stats = Stats(); }
+
+    protected:
+    void anchor(uint64_t localUs, uint64_t showUs) {
+        _localAnchor = localUs;
+        _showAnchor = showUs;
+    }
+
+    uint64_t _localAnchor = 0;
+    uint64_t _showAnchor = 0;
+    int32_t _ratePpb = 0;
+    bool _synced = false;
+    uint64_t _lastBeaconUs = 0;
+    uint8_t _lastSeq = 0;
+    Stats _stats;
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+
+#include "common.h"
+#include "events.hpp"
+
+// Link health per button: the last packets' RSSI, battery voltage, interval to the packet
+// before and the packets lost in between (sequence gap) go into a small ring per button,
+// one sample per packet (repeats don't count). Adding is O(1); min/avg/p95 and the
+// warnings are worked out when asked for, from the ring.
+
+static const int TELEMETRY_BUTTONS = 32;        // buttons with a history, ids above only have the tracker's LinkStats
+static const int TELEMETRY_HISTORY = 32;        // samples per button, power of two
+static const int TELEMETRY_RECENT = 8;          // newest samples, compared against the whole ring
+static const uint32_t TELEMETRY_REPEAT_WINDOW = 500;    // ms, same seq and state within this is a repeat
+
+static const uint16_t BATTERY_LOW_MV = 3400;    // single LiPo cell, little left below this
+static const int8_t RSSI_WEAK = -80;            // dBm, average over the ring
+static const int8_t RSSI_DROP = 6;              // dB, recent samples this much below the ring average: degrading
+static const int LOSS_WARN_PERCENT = 10;
+
+enum LinkWarning : uint8_t {
+    LINK_BATTERY_LOW = 0x01,
+    LINK_WEAK = 0x02,
+    LINK_DEGRADING = 0x04,
+    LINK_LOSSY = 0x08,
+};
+
+class LinkTelemetry {
+    public:
+    struct Range {
+        int min = 0, avg = 0, p95 = 0;
+    };
+
+    struct Summary {
+        int samples = 0;
+        Range rssi;             // dBm, p95 is the weak end
+        Range batteryMv;        // p95 is the low end
+        Range intervalMs;
+        int lossPercent = 0;    // of the packets sent in the window
+        int recentRssi = 0;     // avg of the newest TELEMETRY_RECENT
+        uint16_t lastBatteryMv = 0;
+        uint8_t warnings = 0;   // LinkWarning
+    };
+
+    // one received packet of a button, repeats are skipped
+    void add(int buttonId, const ButtonEvent &ev) {
+        if (buttonId >= TELEMETRY_BUTTONS) return;
+        History &h = _buttons[buttonId];
+        bool sequenced = ev.version >= G2L_PROTOCOL_V2;
+        if (h.count && sequenced && ev.seq == h.lastSeq && ev.btnState == h.lastState && ev.time - h.lastTime < TELEMETRY_REPEAT_WINDOW) {
+            return;
+        }
+
+        Sample &s = h.samples[h.head++ & (TELEMETRY_HISTORY - 1)];
+        s.rssi = ev.rssi;
+        s.batteryMv = ev.batVolt * G2L_BAT_VOLT_FACTOR;
+        s.intervalMs = h.count ? std::min(ev.time - h.lastTime, (uint32_t)UINT16_MAX) : 0;
+        int16_t gap = ev.seq - h.lastSeq;   // check-ins repeat the last sequence number
+        s.lost = h.count && sequenced && gap > 1 ? std::min(gap - 1, 255) : 0;
+        if (h.count < TELEMETRY_HISTORY) h.count++;
+
+        h.lastSeq = ev.seq;
+        h.lastState = ev.btnState;
+        h.lastTime = ev.time;
+    }
+
+    void clear() {
+        for (History &h : _buttons) h = History();
+    }
+
+    Summary summary(int buttonId) const {
+        Summary sum;
+        if (buttonId >= TELEMETRY_BUTTONS) return sum;
+        const History &h = _buttons[buttonId];
+        int n = h.count;
+        if (!n) return sum;
+
+        // newest first
+        int rssi[TELEMETRY_HISTORY], battery[TELEMETRY_HISTORY], interval[TELEMETRY_HISTORY];
+        int intervals = 0, lost = 0, recentSum = 0;
+        for (int i = 0; i < n; i++) {
+            const Sample &s = h.samples[(h.head - 1 - i) & (TELEMETRY_HISTORY - 1)];
+            rssi[i] = s.rssi;
+            battery[i] = s.batteryMv;
+            if (s.intervalMs) interval[intervals++] = s.intervalMs;
+            lost += s.lost;
+            if (i < TELEMETRY_RECENT) recentSum += s.rssi;
+        }
+        sum.samples = n;
+        sum.lastBatteryMv = battery[0];
+        sum.recentRssi = recentSum / std::min(n, TELEMETRY_RECENT);
+        int recentBattery = 0;
+        for (int i = 0; i < std::min(n, TELEMETRY_RECENT); i++) recentBattery += battery[i];
+        recentBattery /= std::min(n, TELEMETRY_RECENT);
+
+        sum.rssi = range(rssi, n, true);
+        sum.batteryMv = range(battery, n, true);
+        sum.intervalMs = range(interval, intervals, false);
+        sum.lossPercent = lost * 100 / (n + lost);
+
+        if (recentBattery && recentBattery < BATTERY_LOW_MV) sum.warnings |= LINK_BATTERY_LOW;
+        if (sum.rssi.avg < RSSI_WEAK) sum.warnings |= LINK_WEAK;
+        if (n >= 2 * TELEMETRY_RECENT && sum.recentRssi < sum.rssi.avg - RSSI_DROP) sum.warnings |= LINK_DEGRADING;
+        if (sum.lossPercent >= LOSS_WARN_PERCENT) sum.warnings |= LINK_LOSSY;
+        return sum;
+    }
+
+    protected:
+    struct Sample {
+        uint16_t intervalMs;    // to the packet before, 0 for the first one
+        uint16_t batteryMv;
+        int8_t rssi;
+        uint8_t lost;           // packets missing in the sequence before this one
+    };
+
+    struct History {
+        Sample samples[TELEMETRY_HISTORY];
+        uint16_t head = 0;
+        uint16_t count = 0;
+        uint16_t lastSeq = 0;
+        uint8_t lastState = 0;
+        uint32_t lastTime = 0;
+    };
+
+    // sorts values. lowWorst: the p95 is taken from the low end (the bad end for RSSI and battery)
+    static Range range(int *values, int n, bool lowWorst) {
+        Range r;
+        if (!n) return r;
+        std::sort(values, values + n);
+        long total = 0;
+        for (int i = 0; i < n; i++) total += values[i];
+        int rank = (n * 95 + 99) / 100 - 1;
+        r.min = values[0];
+        r.avg = total / n;
+        r.p95 = lowWorst ? values[n - 1 - rank] : values[rank];
+        return r;
+    }
+
+    History _buttons[TELEMETRY_BUTTONS];
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Packet transport between buttons and receivers. On the chips this is ESP-NOW, the host
+// tools use UDP on localhost instead, so the receiver's packet path can be loaded with
+// many simulated buttons without any radios. Callbacks may come from another task (the
+// WiFi task for ESP-NOW), like the ESP-NOW ones.
+
+static const uint8_t TRANSPORT_BROADCAST[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+typedef void (*TransportRecvCb)(const uint8_t *srcMac, const uint8_t *data, int len, int8_t rssi);
+typedef void (*TransportSentCb)(bool ok);
+
+class Transport {
+    public:
+    virtual ~Transport() = default;
+
+    virtual bool begin() = 0;
+    virtual bool addPeer(const uint8_t *mac) { return true; }
+    virtual bool send(const uint8_t *destMac, const uint8_t *data, size_t len) = 0;
+
+    void onReceive(TransportRecvCb cb) { _recvCb = cb; }
+    void onSent(TransportSentCb cb) { _sentCb = cb; }
+
+    protected:
+    TransportRecvCb _recvCb = nullptr;
+    TransportSentCb _sentCb = nullptr;
+};
+
+// Datagrams carry the 6 byte source MAC in front of the packet, like the ESP-NOW header,
+// so one socket can stand in for many buttons (sendFrom). Everything goes to one
+// destination port, the destination MAC doesn't matter. Receiving is polled.
+class UdpTransport : public Transport {
+    public:
+    static const int MAX_PACKET = 250;     // ESP-NOW payload limit
+
+    // localPort 0: send only. destPort 0: receive only
+    UdpTransport(const uint8_t *mac, uint16_t localPort, uint16_t destPort, const char *destIp = "127.0.0.1")
+        : _localPort(localPort), _destPort(destPort), _destIp(destIp) {
+        memcpy(_mac, mac, 6);
+    }
+    ~UdpTransport() { end(); }
+
+    bool begin() override {
+        end();
+        _sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (_sock < 0) return false;
+        fcntl(_sock, F_SETFL, fcntl(_sock, F_GETFL, 0) | O_NONBLOCK);
+        int buf = 1 << 20;      // bursts of hundreds of buttons
+        setsockopt(_sock, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+
+        if (_localPort) {
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(_localPort);
+            if (bind(_sock, (sockaddr *)&addr, sizeof(addr)) < 0) return false;
+        }
+        memset(&_dest, 0, sizeof(_dest));
+        _dest.sin_family = AF_INET;
+        _dest.sin_port = htons(_destPort);
+        return inet_aton(_destIp, &_dest.sin_addr) != 0;
+    }
+
+    void end() {
+        if (_sock >= 0) close(_sock);
+        _sock = -1;
+    }
+
+    bool send(const uint8_t *destMac, const uint8_t *data, size_t len) override {
+        return sendFrom(_mac, data, len);
+    }
+
+    // send as if from another node
+    bool sendFrom(const uint8_t *srcMac, const uint8_t *data, size_t len) {
+        uint8_t buf[6 + MAX_PACKET];
+        if (len > MAX_PACKET || _sock < 0 || !_destPort) return false;
+        memcpy(buf, srcMac, 6);
+        memcpy(buf + 6, data, len);
+        bool ok = sendto(_sock, buf, 6 + len, 0, (sockaddr *)&_dest, sizeof(_dest)) == (ssize_t)(6 + len);
+        if (_sentCb) _sentCb(ok);
+        return ok;
+    }
+
+    // delivers everything that arrived to the receive callback, returns the packet count
+    int poll() {
+        uint8_t buf[6 + MAX_PACKET];
+        int count = 0;
+        for (;;) {
+            ssize_t len = recv(_sock, buf, sizeof(buf), 0);
+            if (len < 6) break;
+            count++;
+            if (_recvCb) _recvCb(buf, buf + 6, len - 6, 0);
+        }
+        return count;
+    }
+
+    protected:
+    uint8_t _mac[6];
+    uint16_t _localPort, _destPort;
+    const char *_destIp;
+    int _sock = -1;
+    sockaddr_in _dest;
+};
+
+#ifdef ESP32
+#include <esp_now.h>
+
+// ESP-NOW only takes plain function callbacks, so there is a single instance
+class EspNowTransport : public Transport {
+    public:
+    bool begin() override {
+        _instance = this;
+        if (esp_now_init() != ESP_OK) return false;
+        esp_now_register_recv_cb(recvCb);
+        esp_now_register_send_cb(sentCb);
+        return true;
+    }
+
+    bool addPeer(const uint8_t *mac) override {
+        esp_now_peer_info_t peer = {};
+        memcpy(peer.peer_addr, mac, 6);
+        return esp_now_add_peer(&peer) == ESP_OK;
+    }
+
+    bool send(const uint8_t *destMac, const uint8_t *data, size_t len) override {
+        return esp_now_send(destMac, data, len) == ESP_OK;
+    }
+
+    protected:
+    static void recvCb(const esp_now_recv_info_t *info, const uint8_t *data, int len) {
+        if (_instance->_recvCb) _instance->_recvCb(info->src_addr, data, len, info->rx_ctrl->rssi);
+    }
+    static void sentCb(const uint8_t *mac, esp_now_send_status_t status) {
+        if (_instance->_sentCb) _instance->_sentCb(status == ESP_NOW_SEND_SUCCESS);
+    }
+
+    static inline EspNowTransport *_instance = nullptr;
+};
+#endif
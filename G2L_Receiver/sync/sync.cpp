@@ -0,0 +1,197 @@
+// Host-side simulation of the show clock sync (pio run -e sync -t exec). One master and
+// several followers with their own crystal error and boot time exchange clock beacons
+// over a simulated radio with latency jitter, retries and loss. Prints how far each
+// follower's show clock is off the master's, and how often it shows a different frame
+// than the master (frames are rendered on the show clock grid). Also checks the frame grid
+// of the scheduler where 32 bit microsecond counts wrap and across clock steps.
+//
+// usage: program [-n followers] [-t seconds] [-l loss_percent] [-j jitter_us] [-s seed]
+
+#include <Arduino.h>
+#include <random>
+#include <vector>
+#include <stdlib.h>
+#include <math.h>
+
+#include "common.h"
+#include "showclock.hpp"
+#include "scheduler.hpp"
+
+static const uint32_t SAMPLE_US = 1000;             // how often the clocks are compared
+static const uint32_t SETTLE_S = 5;                 // not counted, the followers lock in
+static const uint32_t FRAME_US = 10000;             // 100Hz, as FRAME_RATE on the receiver
+static const double MAX_DRIFT_PPM = 40;
+static const double RETRY_PERCENT = 3;              // beacons delayed by a retransmission
+static const uint32_t RETRY_US = 1500;
+static const uint32_t DROPOUT_START_S = 60;         // the master goes quiet for a while
+static const uint32_t DROPOUT_S = 30;
+static const uint32_t GRID_STEP_US = 250;           // how often the grid check calls due(), like the receiver loop
+
+struct Node {
+    double driftPpm;
+    double bootUs;          // true time when the node booted, its local clock starts there
+    ShowClock clock;
+    uint64_t pendingShowUs = 0;    // beacon in flight
+    uint8_t pendingSeq = 0;
+    double pendingAt = -1;         // true arrival time, < 0: nothing in flight
+
+    uint64_t localUs(double t) const { return (uint64_t)((t - bootUs) * (1 + driftPpm * 1e-6)); }
+
+    // statistics after settling
+    uint64_t samples = 0;
+    uint64_t frameMismatch = 0;
+    double offsetSumUs = 0;
+    double offsetMaxUs = 0;
+    double dropoutMaxUs = 0;
+};
+
+static void run(std::vector<Node> &nodes, bool sync, uint32_t seconds, double lossPercent, uint32_t jitterUs, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    Node &master = nodes[0];
+    master.clock.setMaster(0);
+    uint8_t seq = 0;
+    double nextBeacon = master.bootUs;
+    double end = seconds * 1e6;
+
+    for (double t = 0; t < end; t += SAMPLE_US) {
+        // master beacons on its own clock, except during the dropout
+        bool dropout = t >= DROPOUT_START_S * 1e6 && t < (DROPOUT_START_S + DROPOUT_S) * 1e6;
+        if (t >= nextBeacon) {
+            nextBeacon += SYNC_BEACON_INTERVAL * 1000 / (1 + master.driftPpm * 1e-6);
+            uint64_t showUs = master.clock.now(master.localUs(t));
+            seq++;
+            for (size_t i = 1; sync && !dropout && i < nodes.size(); i++) {
+                Node &n = nodes[i];
+                if (t < n.bootUs || uniform(rng) * 100 < lossPercent) continue;
+                double delay = SYNC_BEACON_LATENCY_US - jitterUs / 2.0 + uniform(rng) * jitterUs;
+                if (uniform(rng) * 100 < RETRY_PERCENT) delay += RETRY_US;
+                n.pendingShowUs = showUs;
+                n.pendingSeq = seq;
+                n.pendingAt = t + delay;
+            }
+        }
+
+        uint64_t masterShow = master.clock.now(master.localUs(t));
+        for (size_t i = 1; i < nodes.size(); i++) {
+            Node &n = nodes[i];
+            if (t < n.bootUs) continue;
+            if (n.pendingAt >= 0 && t >= n.pendingAt) {
+                n.clock.beacon(n.pendingShowUs, n.pendingSeq, n.localUs(n.pendingAt));
+                n.pendingAt = -1;
+            }
+            if (t < n.bootUs + SETTLE_S * 1e6) continue;
+
+            uint64_t show = n.clock.now(n.localUs(t));
+            double offset = fabs((double)(int64_t)(show - masterShow));
+            n.samples++;
+            n.offsetSumUs += offset;
+            if (dropout) {
+                n.dropoutMaxUs = std::max(n.dropoutMaxUs, offset);
+            }
+            else {
+                n.offsetMaxUs = std::max(n.offsetMaxUs, offset);
+            }
+            if (show / FRAME_US != masterShow / FRAME_US) n.frameMismatch++;
+        }
+    }
+}
+
+static void report(const char *title, const std::vector<Node> &nodes) {
+    printf("\n%s\n%4s %9s %9s %10s %10s %10s %9s %7s %6s %6s\n", title,
+        "node", "drift", "learned", "avg", "max", "dropout", "frames", "beacons", "lost", "steps");
+    for (size_t i = 1; i < nodes.size(); i++) {
+        const Node &n = nodes[i];
+        const ShowClock::Stats &st = n.clock.stats();
+        printf("%4zu %7.1fppm %7.1fppm %8.0fus %8.0fus %8.0fus %8.3f%% %7u %6u %6u\n",
+            i, n.driftPpm, n.clock.ratePpb() / 1000.0, n.samples ? n.offsetSumUs / n.samples : 0, n.offsetMaxUs, n.dropoutMaxUs,
+            n.samples ? 100.0 * n.frameMismatch / n.samples : 0, st.beacons, st.lost, st.steps);
+    }
+}
+
+// runs a scheduler for a while from startUs, every frame has to start in the first step
+// after a multiple of the period and none may count as dropped
+static bool checkGridRun(FrameScheduler &scheduler, uint64_t startUs, uint32_t us, const char *what) {
+    for (uint64_t t = startUs; t < startUs + us; t += GRID_STEP_US) {
+        if (scheduler.due(t) && t % FRAME_US >= GRID_STEP_US) {
+            printf("frame grid: %s, frame at %llu us is %llu us off the grid\n", what, (unsigned long long)t, (unsigned long long)(t % FRAME_US));
+            return false;
+        }
+    }
+    if (scheduler.stats().dropped) {
+        printf("frame grid: %s, %u frames counted as dropped\n", what, scheduler.stats().dropped);
+        return false;
+    }
+    return true;
+}
+
+// show times across 2^32 us (71 min) and the full hours, and show clock steps back within
+// a frame, back by more than a frame and far ahead (a follower locking to its master).
+// Every run starts just after a grid point, so its first frame is on the grid as well
+static bool checkFrameGrid() {
+    auto before = [](uint64_t us, uint32_t ahead) { return us - us % FRAME_US - ahead + 37; };
+    const struct {
+        uint64_t startUs;
+        int64_t stepUs;     // after 100 ms
+        const char *what;
+    } cases[] = {
+        { before(1ULL << 32, 100000),       0,              "across 2^32 us" },
+        { before(3600000000ULL, 100000),    0,              "across 1 h" },
+        { before(1ULL << 33, 100000),       0,              "across 2^33 us" },
+        { before(1ULL << 32, 50000),        -3000,          "stepped back 3 ms across 2^32 us" },
+        { before(1ULL << 32, 50000),        -250000,        "stepped back 250 ms across 2^32 us" },
+        { 1000037,                          3600000000LL,   "stepped ahead 1 h" },
+    };
+    bool ok = true;
+    for (const auto &c : cases) {
+        FrameScheduler scheduler(1000000 / FRAME_US);
+        ok &= checkGridRun(scheduler, c.startUs, 100000, c.what);
+        if (c.stepUs) ok &= checkGridRun(scheduler, c.startUs + 100000 + c.stepUs, 100000, c.what);
+    }
+    printf("frame grid check: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    int followers = 8;
+    uint32_t seconds = 300;
+    double lossPercent = 10;
+    uint32_t jitterUs = 200;
+    uint32_t seed = 1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-n")) followers = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-t")) seconds = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-l")) lossPercent = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "-j")) jitterUs = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-s")) seed = atoi(argv[i + 1]);
+    }
+    printf("%d followers, %u s, %.0f%% beacon loss, %uus latency jitter, master quiet from %us to %us\n",
+        followers, seconds, lossPercent, jitterUs, DROPOUT_START_S, DROPOUT_START_S + DROPOUT_S);
+
+    // node 0 is the master, the others boot within the first few seconds
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> drift(-MAX_DRIFT_PPM, MAX_DRIFT_PPM), boot(0, 3e6);
+    std::vector<Node> nodes(followers + 1);
+    for (Node &n : nodes) {
+        n.driftPpm = drift(rng);
+        n.bootUs = &n == &nodes[0] ? 0 : boot(rng);
+    }
+
+    std::vector<Node> freeRunning = nodes;
+    run(freeRunning, false, seconds, lossPercent, jitterUs, seed);
+    report("without sync (effects run from each receiver's own boot time):", freeRunning);
+
+    run(nodes, true, seconds, lossPercent, jitterUs, seed);
+    report("with sync:", nodes);
+
+    // the worst pair of followers, which is what the audience sees
+    double worst = 0;
+    for (size_t i = 1; i < nodes.size(); i++) {
+        for (size_t j = i + 1; j < nodes.size(); j++) {
+            worst = std::max(worst, nodes[i].offsetMaxUs + nodes[j].offsetMaxUs);
+        }
+    }
+    printf("\nworst follower pair outside the dropout: < %.0fus apart\n", worst);
+    return checkFrameGrid() ? 0 : 1;
+}